@@ -0,0 +1,406 @@
+/*==========================================================================
+
+  tonegen
+  analyze.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  Works out how long a compiled list plays, and roughly what it costs
+  to generate, without playing it or opening any sound device.
+
+  The list isn't stepped through as it would be played, which could
+  take as long as playing it. Instead, each block -- the whole list,
+  the body of a repeat, or a definition -- is worked out once, and
+  the totals of a repeat multiplied by its count. Only the waveform
+  setting affects the cost of a sound, and a block can change it, so
+  each block is worked out for both the waveforms it could start with
+  at the same time. Then a block that is repeated, or played from
+  many places, doesn't have to be worked out again.
+
+  The cost of each sound is estimated from the time taken by the
+  kernel that generates it, measured on this machine. Steady tones
+  are usually played from a cache, so the estimate is on the high
+  side for lists that are mostly tones.
+
+  The tone cache is the only memory used in playing that grows with
+  what the list contains. Its peak is estimated from the largest
+  tones that could be cached, and how many of each -- one per
+  waveform and volume -- could be cached at once. This is an upper
+  bound, as it doesn't depend on the order the tones are played in.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "log.h"
+#include "kernel.h"
+#include "bench.h"
+#include "tonegen.h"
+#include "tonecache.h"
+#include "script.h"
+#include "sink.h"
+#include "analyze.h"
+
+#define WAVEFORM_COUNT 2
+
+// Sound names, in SoundType order
+static const char *analyze_names[SOUND_TYPE_COUNT] =
+  {"random", "sweep", "quiet", "noise", "buzz", "tone"};
+
+// Counts are doubles, so that no list of repeats, however long, can
+//   overflow them
+typedef struct _AnalyzeTotals
+  {
+  double count[SOUND_TYPE_COUNT];
+  double frames[SOUND_TYPE_COUNT];
+  // Frames generated by each kernel
+  double kernel_frames[BENCH_KERNEL_COUNT];
+  } AnalyzeTotals;
+
+// The totals of a block for each waveform it might start with, the
+//   waveform it then leaves set, and the most repeats and calls that
+//   are in progress at once when it's played
+typedef struct _AnalyzeBlock
+  {
+  AnalyzeTotals totals[WAVEFORM_COUNT];
+  Waveform exit[WAVEFORM_COUNT];
+  int depth;
+  } AnalyzeBlock;
+
+// A tone that could be cached, and the frames its rendering takes
+typedef struct _AnalyzeTone
+  {
+  int freq;
+  int frames;
+  } AnalyzeTone;
+
+typedef struct _Analyzer
+  {
+  const Script *script;
+  int rate;
+  int square_quality;
+  // The largest tones, of different frequencies, that could be cached
+  AnalyzeTone tones[TONECACHE_ENTRIES];
+  int ntones;
+  // The volumes and waveforms that are set anywhere
+  BOOL volumes[101];
+  BOOL waveforms[WAVEFORM_COUNT];
+  // The blocks of definitions that have been worked out, by the index
+  //   of their first event
+  AnalyzeBlock **defines;
+  } Analyzer;
+
+// Marks a definition that is being worked out, so that a script that
+//   calls a definition from itself can't recurse forever
+static AnalyzeBlock analyze_in_progress;
+
+static void analyze_block (Analyzer *self, ScriptPart part, int start,
+     int end, AnalyzeBlock *block);
+
+/*==========================================================================
+  analyze_kernel
+  Get the kernel that generates a sound, or -1 if there isn't one
+==========================================================================*/
+static int analyze_kernel (const Analyzer *self, SoundType type,
+     Waveform w)
+  {
+  if (type == sound_type_silence) return -1;
+  if (type == sound_type_noise) return bench_noise;
+  // Sweeps change the step every sample, so they have kernels of 
+  //   their own, which are much slower
+  if (type == sound_type_sweep)
+    {
+    if (w != waveform_square) return bench_sine_sweep;
+    return bench_square_sweep + (self->square_quality >= 2 ? 2 
+      : self->square_quality == 1 ? 1 : 0);
+    }
+  if (type != sound_type_buzz && w != waveform_square) return bench_sine;
+  if (self->square_quality >= 2) return bench_square_blep2;
+  if (self->square_quality == 1) return bench_square_blep1;
+  return bench_square;
+  }
+
+
+/*==========================================================================
+  analyze_tone
+  Note a tone, if it would be cached, as tonegen_get_cached_tone works 
+    it out. Only the largest tones of different frequencies are kept, 
+    as only those can be in the cache at once
+==========================================================================*/
+static void analyze_tone (Analyzer *self, int freq, int64_t frames)
+  {
+  if (freq <= 0) return;
+  // The tone is cached only if it repeats at least once before the
+  //   fade, which is the last 10 msec
+  int64_t fade_start = frames - self->rate / 100;
+  int n = tonecache_loop_frames (freq, self->rate);
+  if (n > fade_start / 2) return;
+  // The rendering is at least a period long, and the file sinks use 
+  //   the longest periods
+  int period = (int64_t)self->rate * SINK_OFFLINE_PERIOD_TIME / 1000000;
+  n *= (period + n - 1) / n;
+
+  int smallest = 0;
+  for (int i = 0; i < self->ntones; i++)
+    {
+    if (self->tones[i].freq == freq) return;
+    if (self->tones[i].frames < self->tones[smallest].frames) smallest = i;
+    }
+  AnalyzeTone tone = {freq, n};
+  if (self->ntones < TONECACHE_ENTRIES)
+    self->tones[self->ntones++] = tone;
+  else if (n > self->tones[smallest].frames)
+    self->tones[smallest] = tone;
+  }
+
+
+/*==========================================================================
+  analyze_cache_frames
+  Get the most frames the tone cache could hold at once. The same 
+    frequency is cached separately for each waveform and volume, so 
+    it may take several entries
+==========================================================================*/
+static int64_t analyze_cache_frames (Analyzer *self, int *entries)
+  {
+  int copies = 0, waveforms = 0;
+  for (int i = 0; i <= 100; i++)
+    if (self->volumes[i]) copies++;
+  for (int i = 0; i < WAVEFORM_COUNT; i++)
+    if (self->waveforms[i]) waveforms++;
+  // The volume set when the list starts may not be any of these
+  copies = (copies + 1) * waveforms;
+
+  // Take the largest tones first
+  AnalyzeTone *tones = self->tones;
+  for (int i = 1; i < self->ntones; i++)
+    for (int j = i; j > 0 && tones[j].frames > tones[j - 1].frames; j--)
+      {
+      AnalyzeTone t = tones[j];
+      tones[j] = tones[j - 1];
+      tones[j - 1] = t;
+      }
+  int64_t frames = 0;
+  *entries = 0;
+  for (int i = 0; i < self->ntones; i++)
+    for (int c = 0; c < copies && *entries < TONECACHE_ENTRIES; c++)
+      {
+      frames += tones[i].frames;
+      (*entries)++;
+      }
+  return frames;
+  }
+
+
+/*==========================================================================
+  analyze_add
+  Add times lots of totals a to t
+==========================================================================*/
+static void analyze_add (AnalyzeTotals *t, const AnalyzeTotals *a,
+     double times)
+  {
+  if (times <= 0) return;
+  for (int i = 0; i < SOUND_TYPE_COUNT; i++)
+    {
+    t->count[i] += a->count[i] * times;
+    t->frames[i] += a->frames[i] * times;
+    }
+  for (int i = 0; i < BENCH_KERNEL_COUNT; i++)
+    t->kernel_frames[i] += a->kernel_frames[i] * times;
+  }
+
+
+/*==========================================================================
+  analyze_play
+  Add a block, played count times, to the totals of the block that
+    contains it. cur is the waveform set at this point, for each
+    waveform the containing block might start with
+==========================================================================*/
+static void analyze_play (AnalyzeBlock *block, Waveform cur[],
+     const AnalyzeBlock *inner, int count)
+  {
+  if (count <= 0) return;
+  for (int x = 0; x < WAVEFORM_COUNT; x++)
+    {
+    // After the first time, a block always starts with the waveform
+    //   it left set the first time
+    Waveform first = cur[x];
+    Waveform rest = inner->exit[first];
+    analyze_add (&block->totals[x], &inner->totals[first], 1);
+    analyze_add (&block->totals[x], &inner->totals[rest], count - 1);
+    cur[x] = count > 1 ? inner->exit[rest] : rest;
+    }
+  }
+
+
+/*==========================================================================
+  analyze_define
+  Get the block of the definition that starts at index, working it out
+    if that hasn't been done already. Returns NULL for a definition
+    that calls itself
+==========================================================================*/
+static const AnalyzeBlock *analyze_define (Analyzer *self, int index)
+  {
+  AnalyzeBlock *block = self->defines[index];
+  if (block == &analyze_in_progress) return NULL;
+  if (!block)
+    {
+    self->defines[index] = &analyze_in_progress;
+    block = malloc (sizeof (AnalyzeBlock));
+    analyze_block (self, script_defs, index,
+      script_length (self->script, script_defs), block);
+    self->defines[index] = block;
+    }
+  return block;
+  }
+
+
+/*==========================================================================
+  analyze_block
+  Work out the events from start up to end, or to the return that
+    ends a definition
+==========================================================================*/
+static void analyze_block (Analyzer *self, ScriptPart part, int start,
+     int end, AnalyzeBlock *block)
+  {
+  memset (block, 0, sizeof (AnalyzeBlock));
+  Waveform cur[WAVEFORM_COUNT] = {waveform_sine, waveform_square};
+  for (int i = start; i < end; i++)
+    {
+    const ScriptEvent *e = script_get (self->script, part, i);
+    if (e->op == script_op_return) break;
+    switch (e->op)
+      {
+      case script_op_wave:
+        cur[0] = cur[1] =
+          e->values[0] == waveform_square ? waveform_square : waveform_sine;
+        self->waveforms[cur[0]] = TRUE;
+        break;
+
+      case script_op_volume:
+        if (e->values[0] >= 0 && e->values[0] <= 100)
+          self->volumes[e->values[0]] = TRUE;
+        break;
+
+      case script_op_sound:
+        {
+        // As tonegen_sound_init works it out
+        int64_t frames = (int64_t)e->values[0] * self->rate / 1000;
+        if (frames < 0) frames = 0;
+        if (e->sound_type == sound_type_tone)
+          analyze_tone (self, e->values[2], frames);
+        for (int x = 0; x < WAVEFORM_COUNT; x++)
+          {
+          AnalyzeTotals *t = &block->totals[x];
+          t->count[e->sound_type]++;
+          t->frames[e->sound_type] += frames;
+          int k = analyze_kernel (self, e->sound_type, cur[x]);
+          if (k >= 0) t->kernel_frames[k] += frames;
+          }
+        }
+        break;
+
+      case script_op_repeat:
+        {
+        // The body is everything up to the loop event
+        int loop = i + e->values[1] - 1;
+        AnalyzeBlock *inner = malloc (sizeof (AnalyzeBlock));
+        analyze_block (self, part, i + 1, loop, inner);
+        analyze_play (block, cur, inner, e->values[0]);
+        if (e->values[0] > 0 && inner->depth + 1 > block->depth)
+          block->depth = inner->depth + 1;
+        free (inner);
+        i = loop;
+        }
+        break;
+
+      case script_op_call:
+        {
+        const AnalyzeBlock *inner = analyze_define (self, e->values[0]);
+        if (inner)
+          {
+          analyze_play (block, cur, inner, 1);
+          if (inner->depth + 1 > block->depth)
+            block->depth = inner->depth + 1;
+          }
+        }
+        break;
+      }
+    }
+  for (int x = 0; x < WAVEFORM_COUNT; x++)
+    block->exit[x] = cur[x];
+  }
+
+
+/*==========================================================================
+  analyze_script
+  Print how long a script plays at the given rate, starting with
+    waveform w, what it's estimated to cost to generate, and the most
+    memory that cached tones could take, at frame_bytes per frame
+==========================================================================*/
+void analyze_script (FILE *f, const Script *script, Waveform w, int rate,
+     int square_quality, int frame_bytes)
+  {
+  LOG_IN
+  Analyzer self;
+  memset (&self, 0, sizeof (self));
+  self.script = script;
+  self.rate = rate;
+  self.square_quality = square_quality;
+  self.waveforms[w == waveform_square ? waveform_square : waveform_sine] 
+    = TRUE;
+  int ndefs = script_length (script, script_defs);
+  self.defines = calloc (ndefs + 1, sizeof (AnalyzeBlock *));
+
+  AnalyzeBlock *block = malloc (sizeof (AnalyzeBlock));
+  analyze_block (&self, script_main, script_start (script),
+    script_length (script, script_main), block);
+  const AnalyzeTotals *t =
+    &block->totals[w == waveform_square ? waveform_square : waveform_sine];
+
+  double total_count = 0, total_frames = 0;
+  fprintf (f, "Sound              Count   Duration (sec)\n");
+  for (int i = 0; i < SOUND_TYPE_COUNT; i++)
+    {
+    if (t->count[i] == 0) continue;
+    fprintf (f, "  %-8s %14.0f %16.3f\n", analyze_names[i], t->count[i],
+      t->frames[i] / rate);
+    total_count += t->count[i];
+    total_frames += t->frames[i];
+    }
+  double secs = total_frames / rate;
+  fprintf (f, "  %-8s %14.0f %16.3f\n", "total", total_count, secs);
+  fprintf (f, "Frames at %d Hz: %.0f\n", rate, total_frames);
+
+  int events = script_length (script, script_main) - script_start (script);
+  fprintf (f, "Compiled: %d events, %d in definitions, %ld bytes\n",
+    events, ndefs, (long)(events + ndefs) * (long)sizeof (ScriptEvent));
+  fprintf (f, "Most repeats and calls in progress at once: %d\n",
+    block->depth);
+  int entries;
+  int64_t cache_frames = analyze_cache_frames (&self, &entries);
+  fprintf (f, "Most tones cached at once: %d (%ld frames, %ld bytes)\n",
+    entries, (long)cache_frames, (long)cache_frames * frame_bytes);
+
+  // Only time the kernels that are needed
+  double ns = 0;
+  for (int i = 0; i < BENCH_KERNEL_COUNT; i++)
+    if (t->kernel_frames[i] > 0)
+      ns += t->kernel_frames[i] * tonegen_measure_kernel ((BenchKernel)i);
+  if (secs > 0)
+    {
+    double per_sec = ns / secs / 1e6;
+    fprintf (f, "Estimated generation cost (%s kernels): "
+      "%.3f msec per second of sound", kernel_get_name (), per_sec);
+    if (per_sec > 0) fprintf (f, " (%.0fx realtime)", 1000 / per_sec);
+    fprintf (f, "\n");
+    }
+
+  for (int i = 0; i < ndefs; i++)
+    if (self.defines[i] != &analyze_in_progress) free (self.defines[i]);
+  free (self.defines);
+  free (block);
+  LOG_OUT
+  }
+
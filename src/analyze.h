@@ -0,0 +1,22 @@
+/*============================================================================
+
+  tonegen
+  analyze.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdio.h>
+#include "defs.h"
+#include "tonegen.h"
+#include "script.h"
+
+BEGIN_DECLS
+
+void analyze_script (FILE *f, const Script *script, Waveform w, int rate,
+       int square_quality, int frame_bytes);
+
+END_DECLS
+
@@ -0,0 +1,125 @@
+/*==========================================================================
+
+  tonegen 
+  bench.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  A built-in benchmark of the sample generation kernels. This runs
+  without an audio device, and takes a few tens of milliseconds, so it
+  can be used to compare settings on the target machine itself. 
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "defs.h" 
+#include "log.h" 
+#include "wavetable.h" 
+#include "kernel.h" 
+#include "rng.h" 
+#include "bench.h" 
+
+// Samples per call to the kernel -- about one period
+#define BENCH_BLOCK 480
+
+// Number of blocks to time, for each kernel
+#define BENCH_BLOCKS 2000
+
+// Phase increment for a 1kHz tone at 48kHz
+#define BENCH_STEP 89478485U
+
+static const char *bench_names[BENCH_KERNEL_COUNT] = 
+  {"sine", "square", "square, quality 1", "square, quality 2", "noise",
+   "sine sweep", "square sweep", "square sweep, qual 1", 
+   "square sweep, qual 2"};
+
+/*==========================================================================
+  bench_now
+  Get a monotonic time in nanoseconds
+==========================================================================*/
+double bench_now (void)
+  {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+  }
+
+
+/*==========================================================================
+  bench_measure
+  Get the average time to generate one sample with the specified 
+    kernel, in nanoseconds. table is the sine table, or NULL to time
+    sin()
+==========================================================================*/
+double bench_measure (BenchKernel kernel, const Wavetable *table)
+  {
+  LOG_IN
+  int16_t block[BENCH_BLOCK];
+  uint32_t phase = 0;
+  Rng rng;
+  rng_seed (&rng, 0);
+  // A linear sweep from 1kHz up to 2kHz, over all the blocks
+  KernelSweep sweep = {BENCH_STEP, 1, 
+    (double)BENCH_STEP / ((double)BENCH_BLOCKS * BENCH_BLOCK)};
+
+  double start = bench_now ();
+  for (int i = 0; i < BENCH_BLOCKS; i++)
+    {
+    switch (kernel)
+      {
+      case bench_sine:
+        kernel_sine (block, BENCH_BLOCK, table, &phase, BENCH_STEP, 32767);
+        break;
+      case bench_square:
+        kernel_square (block, BENCH_BLOCK, &phase, BENCH_STEP, 32767);
+        break;
+      case bench_square_blep1:
+        kernel_square_blep (block, BENCH_BLOCK, &phase, BENCH_STEP, 
+          32767, 1);
+        break;
+      case bench_square_blep2:
+        kernel_square_blep (block, BENCH_BLOCK, &phase, BENCH_STEP, 
+          32767, 2);
+        break;
+      case bench_noise:
+        rng_fill_noise (&rng, block, BENCH_BLOCK);
+        break;
+      case bench_sine_sweep:
+        kernel_sine_sweep (block, BENCH_BLOCK, table, &phase, &sweep, 
+          32767);
+        break;
+      case bench_square_sweep:
+      case bench_square_sweep_blep1:
+      case bench_square_sweep_blep2:
+        kernel_square_sweep (block, BENCH_BLOCK, &phase, &sweep, 32767,
+          kernel - bench_square_sweep);
+        break;
+      }
+    }
+  double ns = (bench_now () - start) / ((double)BENCH_BLOCKS * BENCH_BLOCK);
+  LOG_OUT
+  return ns;
+  }
+
+
+/*==========================================================================
+  bench_run
+  Time all the kernels, and print the results to f
+==========================================================================*/
+void bench_run (FILE *f, const Wavetable *table)
+  {
+  LOG_IN
+  fprintf (f, "Kernels: %s, 1kHz at 48kHz, %d-sample blocks\n", 
+    kernel_get_name (), BENCH_BLOCK);
+  for (int i = 0; i < BENCH_KERNEL_COUNT; i++)
+    {
+    double ns = bench_measure ((BenchKernel)i, table);
+    fprintf (f, "  %-20s %7.2f ns/sample %8.0fx realtime\n", 
+      bench_names[i], ns, 1e9 / (ns * 48000));
+    }
+  LOG_OUT
+  }
+
@@ -0,0 +1,28 @@
+/*============================================================================
+
+  tonegen 
+  bench.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdio.h>
+#include "defs.h"
+#include "wavetable.h"
+
+// Kernels that can be timed by bench_measure
+typedef enum {bench_sine=0, bench_square, bench_square_blep1, 
+  bench_square_blep2, bench_noise, bench_sine_sweep, bench_square_sweep,
+  bench_square_sweep_blep1, bench_square_sweep_blep2} BenchKernel;
+
+#define BENCH_KERNEL_COUNT 9
+
+BEGIN_DECLS
+
+double      bench_now (void);
+double      bench_measure (BenchKernel kernel, const Wavetable *table);
+void        bench_run (FILE *f, const Wavetable *table);
+
+END_DECLS
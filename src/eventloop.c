@@ -0,0 +1,244 @@
+/*==========================================================================
+
+  tonegen 
+  eventloop.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  A single-threaded event loop, built on poll(). It watches any number 
+  of file descriptors for input -- stdin or a socket, for example --
+  and calls a function when something happens to each. 
+
+  One more descriptor can be set as the output. This becomes readable
+  when there is space for more sound, and is only watched while it is
+  enabled -- that is, when there's sound waiting to be written. Since
+  the space may already be there, the output's function is also 
+  called once straight after it is enabled. The loop ends when 
+  eventloop_quit() is called, or when there is nothing left that 
+  could produce an event.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include "defs.h" 
+#include "log.h" 
+#include "eventloop.h" 
+
+typedef struct _EventLoopFd
+  {
+  int fd;
+  EventLoopFdFn fn;
+  void *user_data;
+  // Not watched for the time being -- see eventloop_pause_fd
+  BOOL paused;
+  } EventLoopFd;
+
+struct _EventLoop
+  {
+  EventLoopFd fds[EVENTLOOP_MAX_FDS];
+  int nfds;
+  EventLoopFd output;
+  BOOL output_enabled;
+  // Set when the output is enabled, until its function has been called
+  BOOL output_pending;
+  BOOL quit;
+  }; 
+
+
+/*==========================================================================
+  eventloop_create
+==========================================================================*/
+EventLoop *eventloop_create (void)
+  {
+  LOG_IN
+  EventLoop *self = malloc (sizeof (EventLoop));
+  memset (self, 0, sizeof (EventLoop));
+  LOG_OUT
+  return self;
+  }
+
+
+/*==========================================================================
+  eventloop_destroy
+==========================================================================*/
+void eventloop_destroy (EventLoop *self)
+  {
+  LOG_IN
+  free (self);
+  LOG_OUT
+  }
+
+
+/*==========================================================================
+  eventloop_add_fd
+  Watch fd for input. Returns FALSE if too many descriptors are 
+    already being watched
+==========================================================================*/
+BOOL eventloop_add_fd (EventLoop *self, int fd, EventLoopFdFn fn, 
+     void *user_data)
+  {
+  if (self->nfds == EVENTLOOP_MAX_FDS)
+    {
+    log_error ("Too many inputs -- can't watch descriptor %d", fd);
+    return FALSE;
+    }
+  self->fds[self->nfds].fd = fd;
+  self->fds[self->nfds].fn = fn;
+  self->fds[self->nfds].user_data = user_data;
+  self->fds[self->nfds].paused = FALSE;
+  self->nfds++;
+  return TRUE;
+  }
+
+
+/*==========================================================================
+  eventloop_remove_fd
+  Stop watching fd. This can be called from the fd's own function -- 
+    usually when it has reached end-of-file
+==========================================================================*/
+void eventloop_remove_fd (EventLoop *self, int fd)
+  {
+  for (int i = 0; i < self->nfds; i++)
+    {
+    if (self->fds[i].fd == fd)
+      {
+      memmove (&self->fds[i], &self->fds[i + 1], 
+        (self->nfds - i - 1) * sizeof (EventLoopFd));
+      self->nfds--;
+      return;
+      }
+    }
+  }
+
+
+/*==========================================================================
+  eventloop_pause_fd
+  Stop watching fd for the time being, or start again. While paused, 
+    input just waits in the descriptor -- in the pipe, for example, so
+    that whatever is writing it is held up. This is how a reader limits
+    the input it has to hold
+==========================================================================*/
+void eventloop_pause_fd (EventLoop *self, int fd, BOOL pause)
+  {
+  for (int i = 0; i < self->nfds; i++)
+    {
+    if (self->fds[i].fd == fd)
+      self->fds[i].paused = pause;
+    }
+  }
+
+
+/*==========================================================================
+  eventloop_set_output
+  Set the descriptor that becomes readable when there is space for 
+    more sound. It starts off disabled
+==========================================================================*/
+void eventloop_set_output (EventLoop *self, int fd, EventLoopFdFn fn, 
+     void *user_data)
+  {
+  self->output.fd = fd;
+  self->output.fn = fn;
+  self->output.user_data = user_data;
+  self->output_enabled = FALSE;
+  self->output_pending = FALSE;
+  }
+
+
+/*==========================================================================
+  eventloop_enable_output
+  Start or stop watching the output. It should be enabled whenever 
+    there is sound waiting to be written 
+==========================================================================*/
+void eventloop_enable_output (EventLoop *self, BOOL enable)
+  {
+  if (enable && !self->output_enabled) self->output_pending = TRUE;
+  self->output_enabled = enable;
+  }
+
+
+/*==========================================================================
+  eventloop_quit
+  End eventloop_run, after the current event has been handled
+==========================================================================*/
+void eventloop_quit (EventLoop *self)
+  {
+  self->quit = TRUE;
+  }
+
+
+/*==========================================================================
+  eventloop_run
+  Handle events until eventloop_quit() is called, or there's nothing
+    left to watch. Returns FALSE if poll() fails
+==========================================================================*/
+BOOL eventloop_run (EventLoop *self)
+  {
+  LOG_IN
+  BOOL ret = TRUE;
+  struct pollfd pfds[EVENTLOOP_MAX_FDS + 1];
+
+  self->quit = FALSE;
+  while (!self->quit && (self->nfds > 0 || self->output_enabled))
+    {
+    if (self->output_enabled && self->output_pending)
+      {
+      self->output_pending = FALSE;
+      self->output.fn (self, self->output.fd, self->output.user_data);
+      continue;
+      }
+
+    // The descriptors may have changed in the last pass. poll() 
+    //   ignores a negative descriptor
+    int nfds = self->nfds;
+    for (int i = 0; i < nfds; i++)
+      {
+      pfds[i].fd = self->fds[i].paused ? -1 : self->fds[i].fd;
+      pfds[i].events = POLLIN;
+      pfds[i].revents = 0;
+      }
+    int n = 0;
+    if (self->output_enabled)
+      {
+      pfds[nfds].fd = self->output.fd;
+      pfds[nfds].events = POLLIN;
+      pfds[nfds].revents = 0;
+      n = 1;
+      }
+
+    if (poll (pfds, nfds + n, -1) < 0)
+      {
+      if (errno == EINTR) continue;
+      log_error ("poll() failed: %s", strerror (errno));
+      ret = FALSE;
+      break;
+      }
+
+    if (n > 0 && (pfds[nfds].revents & (POLLIN | POLLHUP | POLLERR)))
+      self->output.fn (self, self->output.fd, self->output.user_data);
+
+    // A function may remove its own descriptor, or another one, so 
+    //   look each one up again
+    for (int i = 0; i < nfds && !self->quit; i++)
+      {
+      if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+        for (int j = 0; j < self->nfds; j++)
+          {
+          if (self->fds[j].fd == pfds[i].fd)
+            {
+            self->fds[j].fn (self, pfds[i].fd, self->fds[j].user_data);
+            break;
+            }
+          }
+        }
+      }
+    }
+
+  LOG_OUT
+  return ret;
+  }
+
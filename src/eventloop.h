@@ -0,0 +1,36 @@
+/*============================================================================
+
+  tonegen 
+  eventloop.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include "defs.h"
+
+// Most file descriptors, other than the output, that can be watched
+#define EVENTLOOP_MAX_FDS 8
+
+struct _EventLoop;
+typedef struct _EventLoop EventLoop;
+
+// Called when a file descriptor can be read, or has reached end-of-file
+typedef void (*EventLoopFdFn) (EventLoop *loop, int fd, void *user_data);
+
+BEGIN_DECLS
+
+EventLoop  *eventloop_create (void);
+void        eventloop_destroy (EventLoop *self);
+BOOL        eventloop_add_fd (EventLoop *self, int fd, EventLoopFdFn fn, 
+              void *user_data);
+void        eventloop_remove_fd (EventLoop *self, int fd);
+void        eventloop_pause_fd (EventLoop *self, int fd, BOOL pause);
+void        eventloop_set_output (EventLoop *self, int fd, 
+              EventLoopFdFn fn, void *user_data);
+void        eventloop_enable_output (EventLoop *self, BOOL enable);
+void        eventloop_quit (EventLoop *self);
+BOOL        eventloop_run (EventLoop *self);
+
+END_DECLS
@@ -0,0 +1,664 @@
+/*==========================================================================
+
+  tonegen
+  kernel.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  Block kernels, that generate a whole period of 16-bit mono samples in
+  one call. There is a plain C version of each kernel and, where the
+  compiler supports them, SSE2 and AVX2 (x86) and NEON (ARM) versions,
+  which calculate four or eight samples at a time.
+
+  kernel_square_blep() produces a band-limited square wave, using 
+  polynomial band-limited steps (PolyBLEP). The naive wave comes from
+  the vector kernels, and only the few samples either side of each edge
+  are corrected, in C.
+
+  kernel_sine_sweep() and kernel_square_sweep() produce waves whose
+  frequency changes with every sample. These are scalar only, since
+  the phase step changes from one sample to the next. 
+
+  kernel_select() chooses the best set of kernels that the CPU
+  supports, once, at start-up. A specific set -- in particular "scalar"
+  -- can be forced by name, for comparison.
+
+  The vector kernels interpolate the sine table in single precision,
+  so their output may differ from the scalar kernels by one LSB.
+  Without a sine table (that is, using sin()), all sets fall back
+  to the scalar sine kernel.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNEL_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define KERNEL_NEON 1
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+#include "defs.h"
+#include "log.h"
+#include "wavetable.h"
+#include "kernel.h"
+
+// Phase is a 32-bit unsigned fraction of a whole cycle, so the top
+//   bit is set for the second half of the cycle
+#define PHASE_HALF_CYCLE 0x80000000U
+
+// Converts the top 24 bits of the fractional part of a table index
+//   into a float in the range 0-1
+#define FRAC_SCALE (1.0f / 16777216.0f)
+
+typedef void (*SineKernel) (int16_t *out, int count,
+  const Wavetable *table, uint32_t *phase, uint32_t step, int vol);
+typedef void (*SquareKernel) (int16_t *out, int count,
+  uint32_t *phase, uint32_t step, int vol);
+
+typedef struct _KernelSet
+  {
+  const char *name;
+  SineKernel sine;
+  SquareKernel square;
+  } KernelSet;
+
+
+/*==========================================================================
+  kernel_sine_scalar
+==========================================================================*/
+static void kernel_sine_scalar (int16_t *out, int count,
+    const Wavetable *table, uint32_t *_phase, uint32_t step, int vol)
+  {
+  uint32_t phase = *_phase;
+  int i;
+  if (table)
+    {
+    for (i = 0; i < count; i++)
+      {
+      out[i] = wavetable_lookup (table, phase) * vol;
+      phase += step;
+      }
+    }
+  else
+    {
+    for (i = 0; i < count; i++)
+      {
+      out[i] = sin (phase * (2. * M_PI / 4294967296.0)) * vol;
+      phase += step;
+      }
+    }
+  *_phase = phase;
+  }
+
+
+/*==========================================================================
+  kernel_square_scalar
+==========================================================================*/
+static void kernel_square_scalar (int16_t *out, int count,
+    uint32_t *_phase, uint32_t step, int vol)
+  {
+  uint32_t phase = *_phase;
+  for (int i = 0; i < count; i++)
+    {
+    out[i] = (phase & PHASE_HALF_CYCLE) ? vol : -vol;
+    phase += step;
+    }
+  *_phase = phase;
+  }
+
+
+#ifdef KERNEL_X86
+/*==========================================================================
+  kernel_sine_sse2
+  Eight samples per iteration, as two groups of four. SSE2 has no
+    gather instruction, so the table entries are loaded one at a time
+==========================================================================*/
+__attribute__((target("sse2")))
+static void kernel_sine_sse2 (int16_t *out, int count,
+    const Wavetable *table, uint32_t *_phase, uint32_t step, int vol)
+  {
+  if (!table)
+    {
+    kernel_sine_scalar (out, count, table, _phase, step, vol);
+    return;
+    }
+  const float *data = wavetable_get_data (table);
+  int bits = wavetable_get_bits (table);
+  BOOL interp = wavetable_get_interp (table) == wavetable_interp_linear;
+  uint32_t phase = *_phase;
+  __m128i ph = _mm_setr_epi32 (phase, phase + step, phase + 2 * step,
+    phase + 3 * step);
+  __m128i inc = _mm_set1_epi32 (4 * step);
+  __m128i shift = _mm_cvtsi32_si128 (32 - bits);
+  __m128i fshift = _mm_cvtsi32_si128 (bits);
+  __m128 fvol = _mm_set1_ps (vol);
+  __m128 fscale = _mm_set1_ps (FRAC_SCALE);
+  int n = count & ~7;
+  for (int i = 0; i < n; i += 8)
+    {
+    __m128i r[2];
+    for (int j = 0; j < 2; j++)
+      {
+      uint32_t idx[4] __attribute__((aligned(16)));
+      _mm_store_si128 ((__m128i *)idx, _mm_srl_epi32 (ph, shift));
+      __m128 v = _mm_setr_ps (data[idx[0]], data[idx[1]],
+        data[idx[2]], data[idx[3]]);
+      if (interp)
+        {
+        __m128 v1 = _mm_setr_ps (data[idx[0] + 1], data[idx[1] + 1],
+          data[idx[2] + 1], data[idx[3] + 1]);
+        __m128 frac = _mm_mul_ps (_mm_cvtepi32_ps (_mm_srli_epi32
+          (_mm_sll_epi32 (ph, fshift), 8)), fscale);
+        v = _mm_add_ps (v, _mm_mul_ps (_mm_sub_ps (v1, v), frac));
+        }
+      r[j] = _mm_cvttps_epi32 (_mm_mul_ps (v, fvol));
+      ph = _mm_add_epi32 (ph, inc);
+      }
+    _mm_storeu_si128 ((__m128i *)(out + i), _mm_packs_epi32 (r[0], r[1]));
+    }
+  phase += (uint32_t)n * step;
+  kernel_sine_scalar (out + n, count - n, table, &phase, step, vol);
+  *_phase = phase;
+  }
+
+
+/*==========================================================================
+  kernel_square_sse2
+  The arithmetic shift of the phase by 31 gives a mask which is all ones
+    in the second half of the cycle, and all zeros in the first
+==========================================================================*/
+__attribute__((target("sse2")))
+static void kernel_square_sse2 (int16_t *out, int count,
+    uint32_t *_phase, uint32_t step, int vol)
+  {
+  uint32_t phase = *_phase;
+  __m128i ph = _mm_setr_epi32 (phase, phase + step, phase + 2 * step,
+    phase + 3 * step);
+  __m128i inc = _mm_set1_epi32 (4 * step);
+  __m128i pv = _mm_set1_epi32 (vol);
+  __m128i nv = _mm_set1_epi32 (-vol);
+  int n = count & ~7;
+  for (int i = 0; i < n; i += 8)
+    {
+    __m128i r[2];
+    for (int j = 0; j < 2; j++)
+      {
+      __m128i sign = _mm_srai_epi32 (ph, 31);
+      r[j] = _mm_or_si128 (_mm_and_si128 (sign, pv),
+        _mm_andnot_si128 (sign, nv));
+      ph = _mm_add_epi32 (ph, inc);
+      }
+    _mm_storeu_si128 ((__m128i *)(out + i), _mm_packs_epi32 (r[0], r[1]));
+    }
+  phase += (uint32_t)n * step;
+  kernel_square_scalar (out + n, count - n, &phase, step, vol);
+  *_phase = phase;
+  }
+
+
+/*==========================================================================
+  kernel_sine_avx2
+  Eight samples per iteration, using the AVX2 gather instruction for
+    the table lookups
+==========================================================================*/
+__attribute__((target("avx2")))
+static void kernel_sine_avx2 (int16_t *out, int count,
+    const Wavetable *table, uint32_t *_phase, uint32_t step, int vol)
+  {
+  if (!table)
+    {
+    kernel_sine_scalar (out, count, table, _phase, step, vol);
+    return;
+    }
+  const float *data = wavetable_get_data (table);
+  int bits = wavetable_get_bits (table);
+  BOOL interp = wavetable_get_interp (table) == wavetable_interp_linear;
+  uint32_t phase = *_phase;
+  __m256i ph = _mm256_setr_epi32 (phase, phase + step, phase + 2 * step,
+    phase + 3 * step, phase + 4 * step, phase + 5 * step,
+    phase + 6 * step, phase + 7 * step);
+  __m256i inc = _mm256_set1_epi32 (8 * step);
+  __m128i shift = _mm_cvtsi32_si128 (32 - bits);
+  __m128i fshift = _mm_cvtsi32_si128 (bits);
+  __m256 fvol = _mm256_set1_ps (vol);
+  __m256 fscale = _mm256_set1_ps (FRAC_SCALE);
+  int n = count & ~7;
+  for (int i = 0; i < n; i += 8)
+    {
+    __m256i idx = _mm256_srl_epi32 (ph, shift);
+    __m256 v = _mm256_i32gather_ps (data, idx, 4);
+    if (interp)
+      {
+      __m256 v1 = _mm256_i32gather_ps (data + 1, idx, 4);
+      __m256 frac = _mm256_mul_ps (_mm256_cvtepi32_ps (_mm256_srli_epi32
+        (_mm256_sll_epi32 (ph, fshift), 8)), fscale);
+      v = _mm256_add_ps (v, _mm256_mul_ps (_mm256_sub_ps (v1, v), frac));
+      }
+    __m256i r = _mm256_cvttps_epi32 (_mm256_mul_ps (v, fvol));
+    _mm_storeu_si128 ((__m128i *)(out + i), _mm_packs_epi32
+      (_mm256_castsi256_si128 (r), _mm256_extracti128_si256 (r, 1)));
+    ph = _mm256_add_epi32 (ph, inc);
+    }
+  phase += (uint32_t)n * step;
+  kernel_sine_scalar (out + n, count - n, table, &phase, step, vol);
+  *_phase = phase;
+  }
+
+
+/*==========================================================================
+  kernel_square_avx2
+==========================================================================*/
+__attribute__((target("avx2")))
+static void kernel_square_avx2 (int16_t *out, int count,
+    uint32_t *_phase, uint32_t step, int vol)
+  {
+  uint32_t phase = *_phase;
+  __m256i ph = _mm256_setr_epi32 (phase, phase + step, phase + 2 * step,
+    phase + 3 * step, phase + 4 * step, phase + 5 * step,
+    phase + 6 * step, phase + 7 * step);
+  __m256i inc = _mm256_set1_epi32 (8 * step);
+  __m256i pv = _mm256_set1_epi32 (vol);
+  __m256i nv = _mm256_set1_epi32 (-vol);
+  int n = count & ~7;
+  for (int i = 0; i < n; i += 8)
+    {
+    __m256i sign = _mm256_srai_epi32 (ph, 31);
+    __m256i r = _mm256_blendv_epi8 (nv, pv, sign);
+    _mm_storeu_si128 ((__m128i *)(out + i), _mm_packs_epi32
+      (_mm256_castsi256_si128 (r), _mm256_extracti128_si256 (r, 1)));
+    ph = _mm256_add_epi32 (ph, inc);
+    }
+  phase += (uint32_t)n * step;
+  kernel_square_scalar (out + n, count - n, &phase, step, vol);
+  *_phase = phase;
+  }
+#endif
+
+
+#ifdef KERNEL_NEON
+/*==========================================================================
+  kernel_sine_neon
+  Four samples per iteration. NEON has no gather, so the table entries
+    are loaded one at a time
+==========================================================================*/
+static void kernel_sine_neon (int16_t *out, int count,
+    const Wavetable *table, uint32_t *_phase, uint32_t step, int vol)
+  {
+  if (!table)
+    {
+    kernel_sine_scalar (out, count, table, _phase, step, vol);
+    return;
+    }
+  const float *data = wavetable_get_data (table);
+  int bits = wavetable_get_bits (table);
+  BOOL interp = wavetable_get_interp (table) == wavetable_interp_linear;
+  uint32_t phase = *_phase;
+  uint32_t init[4] = {phase, phase + step, phase + 2 * step,
+    phase + 3 * step};
+  uint32x4_t ph = vld1q_u32 (init);
+  uint32x4_t inc = vdupq_n_u32 (4 * step);
+  // A negative shift count is a right shift
+  int32x4_t shift = vdupq_n_s32 (-(32 - bits));
+  int32x4_t fshift = vdupq_n_s32 (bits);
+  float32x4_t fvol = vdupq_n_f32 (vol);
+  int n = count & ~3;
+  for (int i = 0; i < n; i += 4)
+    {
+    uint32_t idx[4];
+    vst1q_u32 (idx, vshlq_u32 (ph, shift));
+    float f0[4] = {data[idx[0]], data[idx[1]], data[idx[2]], data[idx[3]]};
+    float32x4_t v = vld1q_f32 (f0);
+    if (interp)
+      {
+      float f1[4] = {data[idx[0] + 1], data[idx[1] + 1],
+        data[idx[2] + 1], data[idx[3] + 1]};
+      float32x4_t v1 = vld1q_f32 (f1);
+      float32x4_t frac = vmulq_n_f32 (vcvtq_f32_u32 (vshrq_n_u32
+        (vshlq_u32 (ph, fshift), 8)), FRAC_SCALE);
+      v = vaddq_f32 (v, vmulq_f32 (vsubq_f32 (v1, v), frac));
+      }
+    int32x4_t r = vcvtq_s32_f32 (vmulq_f32 (v, fvol));
+    vst1_s16 (out + i, vqmovn_s32 (r));
+    ph = vaddq_u32 (ph, inc);
+    }
+  phase += (uint32_t)n * step;
+  kernel_sine_scalar (out + n, count - n, table, &phase, step, vol);
+  *_phase = phase;
+  }
+
+
+/*==========================================================================
+  kernel_square_neon
+==========================================================================*/
+static void kernel_square_neon (int16_t *out, int count,
+    uint32_t *_phase, uint32_t step, int vol)
+  {
+  uint32_t phase = *_phase;
+  uint32_t init[4] = {phase, phase + step, phase + 2 * step,
+    phase + 3 * step};
+  uint32x4_t ph = vld1q_u32 (init);
+  uint32x4_t inc = vdupq_n_u32 (4 * step);
+  int32x4_t pv = vdupq_n_s32 (vol);
+  int32x4_t nv = vdupq_n_s32 (-vol);
+  int n = count & ~3;
+  for (int i = 0; i < n; i += 4)
+    {
+    uint32x4_t sign = vreinterpretq_u32_s32
+      (vshrq_n_s32 (vreinterpretq_s32_u32 (ph), 31));
+    vst1_s16 (out + i, vqmovn_s32 (vbslq_s32 (sign, pv, nv)));
+    ph = vaddq_u32 (ph, inc);
+    }
+  phase += (uint32_t)n * step;
+  kernel_square_scalar (out + n, count - n, &phase, step, vol);
+  *_phase = phase;
+  }
+#endif
+
+
+// Available kernel sets, in increasing order of preference
+static const KernelSet kernel_sets[] =
+  {
+  {"scalar", kernel_sine_scalar, kernel_square_scalar},
+#ifdef KERNEL_X86
+  {"sse2", kernel_sine_sse2, kernel_square_sse2},
+  {"avx2", kernel_sine_avx2, kernel_square_avx2},
+#endif
+#ifdef KERNEL_NEON
+  {"neon", kernel_sine_neon, kernel_square_neon},
+#endif
+  };
+
+#define NUM_KERNEL_SETS (int)(sizeof (kernel_sets) / sizeof (KernelSet))
+
+static const KernelSet *kernel_set = &kernel_sets[0];
+
+
+/*==========================================================================
+  kernel_is_supported
+  Check whether the CPU we're running on can use a particular set
+==========================================================================*/
+static BOOL kernel_is_supported (const KernelSet *set)
+  {
+  const char *name = set->name;
+  if (strcmp (name, "scalar") == 0) return TRUE;
+#ifdef KERNEL_X86
+  __builtin_cpu_init ();
+  if (strcmp (name, "sse2") == 0) return __builtin_cpu_supports ("sse2");
+  if (strcmp (name, "avx2") == 0) return __builtin_cpu_supports ("avx2");
+#endif
+#ifdef KERNEL_NEON
+#ifdef __aarch64__
+  if (strcmp (name, "neon") == 0) return TRUE;
+#else
+  if (strcmp (name, "neon") == 0)
+    return (getauxval (AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+#endif
+  return FALSE;
+  }
+
+
+/*==========================================================================
+  kernel_select
+  Select the set of kernels to use. name may be "auto", to use the best
+    available, or the name of a specific set ("scalar", "sse2", "avx2",
+    "neon"). If the named set is not available, fall back to "auto",
+    and return FALSE
+==========================================================================*/
+BOOL kernel_select (const char *name)
+  {
+  LOG_IN
+  BOOL ret = TRUE;
+  const KernelSet *set = NULL;
+  if (strcmp (name, "auto") != 0)
+    {
+    for (int i = 0; i < NUM_KERNEL_SETS && !set; i++)
+      {
+      if (strcmp (kernel_sets[i].name, name) == 0
+           && kernel_is_supported (&kernel_sets[i]))
+        set = &kernel_sets[i];
+      }
+    if (!set)
+      {
+      log_warning ("Kernel %s is not available on this system", name);
+      ret = FALSE;
+      }
+    }
+  for (int i = NUM_KERNEL_SETS - 1; i >= 0 && !set; i--)
+    {
+    if (kernel_is_supported (&kernel_sets[i]))
+      set = &kernel_sets[i];
+    }
+  kernel_set = set;
+  log_debug ("Using %s kernels", kernel_set->name);
+  LOG_OUT
+  return ret;
+  }
+
+
+/*==========================================================================
+  kernel_get_name
+==========================================================================*/
+const char *kernel_get_name (void)
+  {
+  return kernel_set->name;
+  }
+
+
+/*==========================================================================
+  kernel_blep_residual
+  The difference between a band-limited step and a hard step, of 
+    height 2 * vol, at distance d from the edge (in the same units as
+    phase). inv is 2^48 / step, so we can multiply rather than divide.
+    Quality 1 is the usual two-point PolyBLEP, whose band-limited step
+    is the integral of a triangle (linear B-spline) one sample either
+    side of the edge. Quality 2 integrates a cubic B-spline, which 
+    spans two samples either side, and attenuates aliases more 
+    strongly. All the arithmetic is 16.16 fixed-point
+==========================================================================*/
+static int32_t kernel_blep_residual (uint32_t d, uint64_t inv, int vol,
+    int quality)
+  {
+  // Distance from the edge in samples. d is less than two steps, so this
+  //   can't overflow
+  int64_t s = ((uint64_t)d * inv) >> 32;
+  int64_t g;
+  if (quality == 1)
+    {
+    // (1 - s)^2
+    int64_t u = 65536 - s;
+    g = (u * u) >> 16;
+    return (vol * g) >> 16;
+    }
+  // 24 times the area under the cubic B-spline beyond s 
+  if (s >= 65536)
+    {
+    int64_t t = 131072 - s;
+    int64_t t2 = (t * t) >> 16;
+    g = (t2 * t2) >> 16;
+    }
+  else
+    {
+    int64_t s2 = (s * s) >> 16;
+    int64_t s3 = (s2 * s) >> 16;
+    int64_t s4 = (s3 * s) >> 16;
+    g = 12 * 65536 - 16 * s + 8 * s3 - 3 * s4;
+    }
+  return (vol * g) / (12 * 65536);
+  }
+
+
+/*==========================================================================
+  kernel_blep
+  The correction to apply to a sample at phase d after a rising edge,
+    if it's close enough to the edge to need one. span is the
+    distance either side of the edge that is affected
+==========================================================================*/
+static inline int32_t kernel_blep (uint32_t d, uint64_t inv, 
+    uint64_t span, int vol, int quality)
+  {
+  if (d < span)
+    return -kernel_blep_residual (d, inv, vol, quality);
+  if ((uint32_t)-d < span)
+    return kernel_blep_residual (-d, inv, vol, quality);
+  return 0;
+  }
+
+
+/*==========================================================================
+  kernel_square_blep
+  As kernel_square, but band-limited, to reduce aliasing. quality is
+    1 or 2 (see kernel_blep_residual). Quality 0 is the naive square
+    wave, produced by kernel_square
+==========================================================================*/
+void kernel_square_blep (int16_t *out, int count, uint32_t *_phase,
+     uint32_t step, int vol, int quality)
+  {
+  if (quality <= 0 || step == 0)
+    {
+    kernel_square (out, count, _phase, step, vol);
+    return;
+    }
+  uint32_t phase = *_phase;
+  uint64_t span = (uint64_t)step * (quality == 1 ? 1 : 2);
+  uint64_t inv = ((uint64_t)1 << 48) / step;
+  // Start with the naive wave, which may use the vector kernels, and
+  //   then correct only the samples close to an edge. Both edges are at
+  //   multiples of half a cycle, so x (below) is less than 2 * span for
+  //   a sample close to either of them. Between edges, we skip straight
+  //   to the next one
+  kernel_square (out, count, _phase, step, vol);
+  int i = 0;
+  while (i < count)
+    {
+    uint32_t x = (phase + (uint32_t)span) & (PHASE_HALF_CYCLE - 1);
+    if (x < 2 * span)
+      {
+      int32_t v = out[i];
+      // The wave rises at half a cycle, and falls at the end of the cycle 
+      v += kernel_blep (phase - PHASE_HALF_CYCLE, inv, span, vol, quality);
+      v -= kernel_blep (phase, inv, span, vol, quality);
+      if (v > 32767) v = 32767;
+      if (v < -32768) v = -32768;
+      out[i] = v;
+      i++;
+      phase += step;
+      }
+    else
+      {
+      uint32_t skip = (PHASE_HALF_CYCLE - x + step - 1) / step;
+      i += skip;
+      phase += skip * step;
+      }
+    }
+  }
+
+
+/*==========================================================================
+  kernel_sweep_step
+  The phase step for a sweep step that may be outside the range of a
+    uint32_t, which converting directly would be undefined. Like 
+    tonegen_phase_increment, a frequency at or above the sample rate
+    wraps modulo 2^32, and one below zero gives no step
+==========================================================================*/
+static inline uint32_t kernel_sweep_step (double step)
+  {
+  if (step < 4294967296.0)
+    return step > 0 ? (uint32_t)step : 0;
+  return (uint32_t)fmod (step, 4294967296.0);
+  }
+
+
+/*==========================================================================
+  kernel_sine_sweep
+  As kernel_sine, but the phase step changes after every sample, as
+    described by sweep. On return, sweep holds the step for the next 
+    sample, so the sweep can continue into the next block
+==========================================================================*/
+void kernel_sine_sweep (int16_t *out, int count, const Wavetable *table,
+     uint32_t *_phase, KernelSweep *sweep, int vol)
+  {
+  uint32_t phase = *_phase;
+  double step = sweep->step;
+  for (int i = 0; i < count; i++)
+    {
+    if (table)
+      out[i] = wavetable_lookup (table, phase) * vol;
+    else
+      out[i] = sin (phase * (2. * M_PI / 4294967296.0)) * vol;
+    phase += kernel_sweep_step (step);
+    step = step * sweep->ratio + sweep->delta;
+    }
+  *_phase = phase;
+  sweep->step = step;
+  }
+
+
+/*==========================================================================
+  kernel_square_sweep
+  As kernel_square_blep, but the phase step changes after every 
+    sample, as described by sweep
+==========================================================================*/
+void kernel_square_sweep (int16_t *out, int count, uint32_t *_phase,
+     KernelSweep *sweep, int vol, int quality)
+  {
+  uint32_t phase = *_phase;
+  double step = sweep->step;
+  for (int i = 0; i < count; i++)
+    {
+    uint32_t s = kernel_sweep_step (step);
+    int32_t v = (phase & PHASE_HALF_CYCLE) ? vol : -vol;
+    if (quality > 0 && s > 0)
+      {
+      uint64_t span = (uint64_t)s * (quality == 1 ? 1 : 2);
+      uint32_t x = (phase + (uint32_t)span) & (PHASE_HALF_CYCLE - 1);
+      if (x < 2 * span)
+        {
+        uint64_t inv = ((uint64_t)1 << 48) / s;
+        v += kernel_blep (phase - PHASE_HALF_CYCLE, inv, span, vol, quality);
+        v -= kernel_blep (phase, inv, span, vol, quality);
+        if (v > 32767) v = 32767;
+        if (v < -32768) v = -32768;
+        }
+      }
+    out[i] = v;
+    phase += s;
+    step = step * sweep->ratio + sweep->delta;
+    }
+  *_phase = phase;
+  sweep->step = step;
+  }
+
+
+/*==========================================================================
+  kernel_sine
+  Fill out with count samples of a sine wave of amplitude vol, starting
+    at *phase and advancing by step each sample. On return, *phase is
+    the phase of the next sample. If table is NULL, sin() is used
+==========================================================================*/
+void kernel_sine (int16_t *out, int count, const Wavetable *table,
+     uint32_t *phase, uint32_t step, int vol)
+  {
+  kernel_set->sine (out, count, table, phase, step, vol);
+  }
+
+
+/*==========================================================================
+  kernel_square
+  As kernel_sine, but for a square wave of amplitude vol
+==========================================================================*/
+void kernel_square (int16_t *out, int count, uint32_t *phase,
+     uint32_t step, int vol)
+  {
+  kernel_set->square (out, count, phase, step, vol);
+  }
+
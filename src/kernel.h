@@ -0,0 +1,45 @@
+/*============================================================================
+
+  tonegen 
+  kernel.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "defs.h"
+#include "wavetable.h"
+
+// Highest quality setting for kernel_square_blep
+#define KERNEL_MAX_QUALITY 2
+
+// State of a frequency sweep. After each sample, the phase step is 
+//   multiplied by ratio and then delta is added -- so a linear sweep
+//   has a ratio of 1, and an exponential sweep has a delta of 0
+typedef struct _KernelSweep
+  {
+  double step;
+  double ratio;
+  double delta;
+  } KernelSweep;
+
+BEGIN_DECLS
+
+BOOL        kernel_select (const char *name);
+const char *kernel_get_name (void);
+
+void        kernel_sine (int16_t *out, int count, const Wavetable *table,
+              uint32_t *phase, uint32_t step, int vol);
+void        kernel_square (int16_t *out, int count, uint32_t *phase, 
+              uint32_t step, int vol);
+void        kernel_square_blep (int16_t *out, int count, uint32_t *phase, 
+              uint32_t step, int vol, int quality);
+void        kernel_sine_sweep (int16_t *out, int count, 
+              const Wavetable *table, uint32_t *phase, KernelSweep *sweep,
+              int vol);
+void        kernel_square_sweep (int16_t *out, int count, uint32_t *phase, 
+              KernelSweep *sweep, int vol, int quality);
+
+END_DECLS
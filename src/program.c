@@ -23,26 +23,80 @@
 #include <getopt.h>
 #include <wchar.h>
 #include <time.h>
-#include <alsa/asoundlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "program_context.h" 
 #include "feature.h" 
 #include "program.h" 
 #include "console.h" 
 #include "string.h" 
 #include "numberformat.h" 
+#include "eventloop.h" 
 #include "tonegen.h" 
+#include "script.h" 
+#include "scriptparser.h" 
+#include "analyze.h" 
+#include "bench.h" 
 
 // Largest possible number of number arguments in a command-line
 //   value
 #define MAX_NUM_ARGS 10
 
+// Most events that are compiled from input, ahead of what is being
+//   played, before we stop reading it. Reading starts again when half
+//   of them have been played, so however fast a script writes, we 
+//   only hold a few sounds, and the script waits
+#define MAX_PENDING_EVENTS 64
+
+// Played events are only removed from the script once there are this
+//   many, to save moving the rest every time
+#define DISCARD_EVENTS 64
+
+// Everything needed to play a sequence of sounds. The sounds are 
+//   compiled into a script, which is then played. The script may be 
+//   given on the command line, or compiled from stdin while earlier 
+//   parts of it are playing
+typedef struct _Player
+  {
+  EventLoop *loop;
+  Script *script;
+  ScriptParser *parser;
+  // Where the script is being played from
+  ScriptCursor cursor;
+  // The sound being played, if playing is TRUE
+  TonegenSound current;
+  BOOL playing;
+  // TRUE when nothing more will be added to the script
+  BOOL input_done;
+  // Settings that apply to sounds as they're played
+  Waveform w;
+  SweepCurve curve;
+  int vol;
+  // Where the list is being read from, or -1, and whether reading
+  //   has been paused because too much is waiting to be played
+  int input_fd;
+  BOOL input_paused;
+  // A list file that is being compiled as it's played: the mapping 
+  //   of the whole file, or NULL, and the part still to compile
+  void *map;
+  size_t map_size;
+  const char *text;
+  size_t text_left;
+  } Player;
+
+static void program_list_end (Player *self);
+
 /*==========================================================================
   program_parse_nums
-  Note that this method cannot fail, in itself. Any bad numbers are
-   just skipped. We might end up with an empty list of arguments,
-   but that's something for the caller to figure out
+  Parse up to max comma-separated numbers into nums. Any bad numbers 
+   are just skipped. We might end up with an empty list of arguments,
+   but that's something for the caller to figure out. If there are 
+   more than max numbers, that's an error, and -1 is returned
 ==========================================================================*/
-int program_parse_nums (const char *_s, int nums[])
+int program_parse_nums (const char *_s, int nums[], int max)
   {
   LOG_IN
   int ret = 0;
@@ -51,11 +105,17 @@ int program_parse_nums (const char *_s, int nums[])
 
   char *tok = strtok (s, ","); 
   int i = 0;
-  while (tok && i < MAX_NUM_ARGS)
+  while (tok)
     {
     uint64_t num = 0;
      if (numberformat_read_integer (tok, &num, TRUE))
       {
+      if (i == max)
+        {
+        log_error ("Too many values in %s -- at most %d allowed", _s, max);
+        i = -1;
+        break;
+        }
       nums[i] = (int)num;
       i++;
       }
@@ -70,352 +130,584 @@ int program_parse_nums (const char *_s, int nums[])
   }
 
 /*==========================================================================
-  program_play_sound
+  program_pending
+  Get the number of compiled events that are waiting to be played, or
+    may be played again
 ==========================================================================*/
-void program_play_sound (snd_pcm_t *handle, SoundType sound_type, 
-     Waveform w, int volume,
-     int *nums, int args, snd_pcm_sframes_t period_size)
+static int program_pending (const Player *self)
   {
-  switch (sound_type)
+  return scriptparser_get_complete (self->parser) 
+    - script_cursor_oldest (&self->cursor);
+  }
+
+/*==========================================================================
+  program_list_more
+  Compile more of a list file, until max_pending events are waiting to
+    be played, or the file ends
+==========================================================================*/
+static void program_list_more (Player *self, int max_pending)
+  {
+  while (self->text_left > 0 && !scriptparser_is_done (self->parser)
+      && program_pending (self) < max_pending)
     {
-    case sound_type_tone: 
-      if (args == 2)
-        tonegen_play_sound (handle, sound_type_tone, w, volume,
-           nums[0], 0, nums[1], 0, period_size); 
-      else
-        log_error 
-           (VERB_TONE "takes two values: duration (ms), frequency (Hz)");
-      break;
-    
-    case sound_type_buzz: 
-      if (args == 2)
-        tonegen_play_sound (handle, sound_type_buzz, w, volume,
-           nums[0], 0, nums[1], 0, period_size); 
-      else
-        log_error 
-           (VERB_BUZZ " takes two values: duration (ms), frequency (Hz)");
-      break;
-
-    case sound_type_noise:
-      if (args == 1)
-        tonegen_play_sound (handle, sound_type_noise, w, volume,
-           nums[0], 0, 0, 0, period_size); 
-      else
-        log_error 
-           (VERB_NOISE " takes value: duration (ms)");
-      break;
-
-    case sound_type_silence:
-      if (args == 1)
-        tonegen_play_sound (handle, sound_type_silence, w, volume,
-           nums[0], 0, 0, 0, period_size); 
-      else
-        log_error 
-           (VERB_QUIET " takes value: duration (ms)");
-      break;
-
-    case sound_type_sweep:
-      if (args == 3)
-        tonegen_play_sound (handle, sound_type_sweep, w, volume,
-           nums[0], 0, nums[1], nums[2], period_size); 
-      else
-        log_error 
-           (VERB_SWEEP 
-             " takes three values: duration (ms), start(Hz), end(Hz)");
-       break;
-
-    case sound_type_random:
-      if (args == 4)
-        tonegen_play_sound (handle, sound_type_random, w, volume,
-           nums[0], nums[1], nums[2], nums[3], period_size); 
-      else
-        log_error 
-           (VERB_RANDOM " takes three values: duration (ms), min(Hz), max(Hz)");
-      break;
+    int n = self->text_left > 4096 ? 4096 : (int)self->text_left;
+    scriptparser_feed (self->parser, self->text, n);
+    self->text += n;
+    self->text_left -= n;
+    }
+  if (self->text_left == 0 || scriptparser_is_done (self->parser))
+    {
+    munmap (self->map, self->map_size);
+    self->map = NULL;
+    self->text_left = 0;
+    program_list_end (self);
     }
   }
 
 /*==========================================================================
-  program_play_list
+  program_next_sound
+  Play the script until the next sound, and make that the current one.
+    Returns FALSE if there are no sounds waiting
 ==========================================================================*/
-void program_play_list (snd_pcm_t *handle, const char *arg, 
-    snd_pcm_sframes_t period_size, Waveform init_w, int init_vol)
+static BOOL program_next_sound (Player *self)
   {
-  LOG_IN
-  char *s = NULL;
-  if (strcmp (arg, "-") == 0)
+  Script *script = self->script;
+  if (self->map && program_pending (self) <= MAX_PENDING_EVENTS / 2)
+    program_list_more (self, MAX_PENDING_EVENTS);
+  int complete = scriptparser_get_complete (self->parser);
+  const ScriptEvent *e;
+  BOOL found = FALSE;
+  while (!found && (e = script_next (script, &self->cursor, complete)))
     {
-    // Use stdin
-    int c;
-    int buffsize = 10;
-    int i = 0;
-    char *buff = malloc (buffsize + 1);
-    while ((c = getc (stdin)) > 0)
+    switch (e->op)
       {
-      if (i > buffsize)
-        {
-        buffsize *= 2;
-        buff = realloc (buff, buffsize + 1);
-        }
-      buff[i] = c;
-      i++;
+      case script_op_wave: 
+        self->w = (Waveform) e->values[0]; 
+        break;
+      case script_op_volume: 
+        self->vol = e->values[0]; 
+        break;
+      case script_op_curve: 
+        self->curve = (SweepCurve) e->values[0]; 
+        break;
+      case script_op_sound:
+        tonegen_sound_init (&self->current, e->sound_type, self->w, 
+          self->curve, self->vol, e->values[0], e->values[1], 
+          e->values[2], e->values[3]);
+        self->playing = TRUE;
+        found = TRUE;
+        break;
       }
-    buff[i] = 0;
-    buff = realloc (buff, strlen (buff) + 10);
-    strcat (buff, " stop");
-    s = strdup (buff);
-    free (buff);
     }
-  else
+
+  // While input is being compiled, the script only needs to hold what
+  //   can still be played
+  int oldest = script_cursor_oldest (&self->cursor);
+  if (!self->input_done && oldest - script_start (script) >= DISCARD_EVENTS)
+    script_discard (script, oldest);
+  if (self->input_paused && program_pending (self) <= MAX_PENDING_EVENTS / 2)
     {
-    s = malloc (strlen (arg) + 10);
-    strcpy (s, arg);
-    strcat (s, " stop"); 
+    eventloop_pause_fd (self->loop, self->input_fd, FALSE);
+    self->input_paused = FALSE;
     }
+  return found;
+  }
 
-  Waveform w = init_w; 
-  int vol = init_vol;
-  
-  BOOL stop = FALSE;
-  char *tok = strtok (s, " \t\n,");
-  int mode = 0;
-  int args = 0;
-  SoundType t = -1;
-  int nums[MAX_NUM_ARGS];
-  if (tok) do
+/*==========================================================================
+  program_output_ready
+  Called by the event loop when there is space for more sound. Keep 
+    generating sounds until there's no more space, or there are no 
+    more sounds
+==========================================================================*/
+static void program_output_ready (EventLoop *loop, int fd, 
+     void *user_data)
+  {
+  Player *self = user_data;
+  for (;;)
     {
-    log_debug ("tok=%s", tok);
-    if (mode == 0) // looking for verb 
+    if (!self->playing && !program_next_sound (self))
       {
-      if (strcmp (tok, VERB_TONE) == 0)
-        t = sound_type_tone;
-      else if (strcmp (tok, VERB_NOISE) == 0)
-        t = sound_type_noise;
-      else if (strcmp (tok, VERB_BUZZ) == 0)
-        t = sound_type_buzz;
-      else if (strcmp (tok, VERB_QUIET) == 0)
-        t = sound_type_silence;
-      else if (strcmp (tok, VERB_RANDOM) == 0)
-        t = sound_type_random;
-      else if (strcmp (tok, VERB_SWEEP) == 0)
-        t = sound_type_sweep;
-      else if (strcmp (tok, VERB_WAVE) == 0)
-        t = 100;
-      else if (strcmp (tok, VERB_VOLUME) == 0)
-        t = 101;
-
-      if (t >= 0)
-        {
-        log_debug ("got verb, looking for number");
-        mode = 1;
-        }
+      eventloop_enable_output (loop, FALSE);
+      if (self->input_done)
+        eventloop_quit (loop);
       else
         {
-        log_error ("%s is neither a sound type nor a number", tok);
+        // Play what we have, while waiting for more input
+        tonegen_start ();
         }
+      return;
       }
-    else if (mode == 1) // Expecting number
+    int err = tonegen_fill (&self->current);
+    if (err < 0)
       {
-      log_debug ("Expecting number, tok=%s", tok);
-      uint64_t v;
-      SoundType t2 = -2;
-      if (strcmp (tok, VERB_TONE) == 0)
-        t2 = sound_type_tone;
-      else if (strcmp (tok, VERB_NOISE) == 0)
-        t2 = sound_type_noise;
-      else if (strcmp (tok, "stop") == 0)
-        t2 = -1; 
-      else if (strcmp (tok, VERB_BUZZ) == 0)
-        t2 = sound_type_buzz;
-      else if (strcmp (tok, VERB_QUIET) == 0)
-        t2 = sound_type_silence;
-      else if (strcmp (tok, VERB_RANDOM) == 0)
-        t2 = sound_type_random;
-      else if (strcmp (tok, VERB_SWEEP) == 0)
-        t2 = sound_type_sweep;
-      else if (strcmp (tok, VERB_WAVE) == 0)
-        t2 = 100; // Ugh -- tidy this up
-      else if (strcmp (tok, VERB_VOLUME) == 0)
-        t2 = 101; // Ugh -- tidy this up
-      if (t2 != -2)
-        {
-        log_debug ("Got %s whilst expecting number", tok);
-        if (args > 0)
-          {
-          if (t == 100)
-            {
-            if (args == 1)
-              {
-              w = (Waveform) nums[0];
-              }
-            else
-              log_error (VERB_WAVE " takes one argument -- 0 or 1");
-            }
-          else if (t == 101)
-            {
-            if (args == 1)
-              {
-              vol = nums[0];
-              if (vol > 100) vol = 100;
-              if (vol < 0) vol = 0;
-              }
-            else
-              log_error (VERB_VOLUME " takes one argument -- 0 or 1");
-            }
-          else
-            {
-            program_play_sound (handle, t, w, vol,
-              nums, args, period_size); 
-            }
-          log_debug ("got %d args, sound %d", args, t);
-          args = 0;
-          mode = 1;
-          }
-        t = t2; 
-        }
-      else if (numberformat_read_integer (tok, &v, TRUE))
-        {
-        if (args < MAX_NUM_ARGS)
-          nums[args] = v;
-        args++;
-        }
-      else
-        {
-        log_warning ("%s is neither a sound type nor a number", tok); 
-        }
-      if (t == -1) stop = TRUE;
+      log_error ("Can't play sound: %s", strerror (-err));
+      eventloop_quit (loop);
+      return;
       }
+    if (!tonegen_sound_finished (&self->current)) return;
+    self->playing = FALSE;
+    }
+  }
 
-    tok = strtok (NULL, " \t,\n");
-    } while (tok && !stop); 
+/*==========================================================================
+  program_list_end
+  Called at the end of the list, or when "stop" is found. Nothing more
+    will be compiled after this
+==========================================================================*/
+static void program_list_end (Player *self)
+  {
+  scriptparser_finish (self->parser);
+  self->input_done = TRUE;
+  // Let the output finish off, so the loop can end
+  eventloop_enable_output (self->loop, TRUE);
+  }
 
-  free (s);
-  LOG_OUT
+/*==========================================================================
+  program_stdin_ready
+  Called by the event loop when there is input. Each sound is compiled
+    as soon as it has all its values, and can then be played. If too
+    much is waiting to be played, input is paused until 
+    program_next_sound has caught up
+==========================================================================*/
+static void program_stdin_ready (EventLoop *loop, int fd, void *user_data)
+  {
+  Player *self = user_data;
+  char buff[4096];
+  int n = read (fd, buff, sizeof (buff));
+  if (n > 0)
+    {
+    scriptparser_feed (self->parser, buff, n);
+    if (program_pending (self) > 0)
+      eventloop_enable_output (loop, TRUE);
+    }
+  if (n <= 0 || scriptparser_is_done (self->parser))
+    {
+    if (n < 0) log_error ("Can't read input: %s", strerror (errno));
+    program_list_end (self);
+    eventloop_remove_fd (loop, fd);
+    self->input_fd = -1;
+    self->input_paused = FALSE;
+    }
+  else if (program_pending (self) >= MAX_PENDING_EVENTS)
+    {
+    eventloop_pause_fd (loop, fd, TRUE);
+    self->input_paused = TRUE;
+    }
   }
 
+/*==========================================================================
+  program_play
+  Play all the sounds that have been, or will be, compiled, and then wait
+    for the sink to finish playing them
+==========================================================================*/
+static void program_play (Player *self)
+  {
+  LOG_IN
+  eventloop_set_output (self->loop, tonegen_get_output_fd (), 
+    program_output_ready, self);
+  eventloop_enable_output (self->loop, TRUE);
+  eventloop_run (self->loop);
+  tonegen_wait ();
+  LOG_OUT
+  }
 
 /*==========================================================================
-  program_run
+  program_report_render
+  Say how much sound was written, and how much faster than real time
+    that was, given the time it took in nanoseconds
+==========================================================================*/
+static void program_report_render (FILE *f, double elapsed)
+  {
+  SinkStats stats;
+  tonegen_get_stats (&stats);
+  double secs = (double)stats.frames_written / tonegen_get_rate ();
+  elapsed /= 1e9;
+  fprintf (f, "Rendered %.2f sec of sound in %.3f sec", secs, elapsed);
+  if (elapsed > 0)
+    fprintf (f, " (%.0fx realtime)", secs / elapsed);
+  fprintf (f, "\n");
+  }
 
-  The return value will eventually become the exit value from the program.
+/*==========================================================================
+  program_player_init
 ==========================================================================*/
-int program_run (ProgramContext *context)
+static void program_player_init (Player *self, Waveform w, 
+    SweepCurve curve, int vol)
   {
-  LOG_IN
-  //char ** const argv = program_context_get_nonswitch_argv (context);
-  //int argc = program_context_get_nonswitch_argc (context);
+  memset (self, 0, sizeof (Player));
+  self->loop = eventloop_create ();
+  self->input_fd = -1;
+  self->script = script_create ();
+  script_cursor_init (&self->cursor);
+  self->parser = scriptparser_create (self->script);
+  self->w = w;
+  self->curve = curve;
+  self->vol = vol;
+  }
 
-  srand (time (NULL));
+/*==========================================================================
+  program_player_cleanup
+==========================================================================*/
+static void program_player_cleanup (Player *self)
+  {
+  eventloop_destroy (self->loop);
+  if (self->map) munmap (self->map, self->map_size);
+  scriptparser_destroy (self->parser);
+  script_destroy (self->script);
+  }
 
-  Waveform w = program_context_get_integer (context, VERB_WAVE, 0);
-  int volume = program_context_get_integer (context, VERB_VOLUME, 100);
 
-  snd_pcm_t *handle;
-  snd_pcm_sframes_t period_size;
-  const char *device = program_context_get (context, "device"); 
-  if (!device) device = "default";
-  if (tonegen_setup_sound (&handle, device, &period_size))
+/*==========================================================================
+  program_list_file
+  Compile a list from a file. The file is mapped into memory, and 
+    compiled where it is, a little ahead of what is being played, so
+    even a very large list is never copied, and only a few sounds are
+    held in compiled form. Returns TRUE if that is being done. If the 
+    file can't be mapped -- a pipe, for example -- it is read a piece
+    at a time, and compiled completely, and FALSE is returned
+==========================================================================*/
+static BOOL program_list_file (Player *self, const char *filename)
+  {
+  LOG_IN
+  BOOL ret = FALSE;
+  int fd = open (filename, O_RDONLY);
+  if (fd >= 0)
     {
-    int nums [MAX_NUM_ARGS];
-
-    log_debug ("period_size=%ld\n", period_size);
+    struct stat sb;
+    void *map = MAP_FAILED;
+    if (fstat (fd, &sb) == 0 && S_ISREG (sb.st_mode) && sb.st_size > 0)
+      map = mmap (NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED)
+      {
+      madvise (map, sb.st_size, MADV_SEQUENTIAL);
+      self->map = map;
+      self->map_size = sb.st_size;
+      self->text = map;
+      self->text_left = sb.st_size;
+      program_list_more (self, MAX_PENDING_EVENTS);
+      ret = TRUE;
+      }
+    else
+      {
+      char buff[4096];
+      int n = 0;
+      while (!scriptparser_is_done (self->parser) 
+          && (n = read (fd, buff, sizeof (buff))) > 0)
+        scriptparser_feed (self->parser, buff, n);
+      if (n < 0) log_error ("Can't read %s: %s", filename, strerror (errno));
+      }
+    // The mapping stays after the file is closed
+    close (fd);
+    }
+  else
+    log_error ("Can't open %s: %s", filename, strerror (errno));
+  LOG_OUT
+  return ret;
+  }
 
-    const char *v;
-    if ((v = program_context_get (context, VERB_TONE)))
+/*==========================================================================
+  program_compile
+  Compile the sounds given on the command line. A list from stdin, or
+    a list file, is compiled during playback, as it is needed. 
+    Anything else is compiled completely. Returns FALSE if a compiled
+    list couldn't be loaded, having logged the reason
+==========================================================================*/
+static BOOL program_compile (Player *self, ProgramContext *context)
+  {
+  int nums [MAX_NUM_ARGS];
+  BOOL streaming = FALSE;
+  const char *v;
+  if ((v = program_context_get (context, VERB_TONE)))
+    {
+    int args = program_parse_nums (v, nums, MAX_NUM_ARGS);
+    if (args == 2)
       {
-      int args = program_parse_nums (v, nums);
-      if (args == 2)
-        {
-        program_play_sound (handle, sound_type_tone, w, volume,
-           nums, 2, period_size); 
-        tonegen_wait (handle);
-        }
-      else
-        log_error 
-           ("--" VERB_TONE " takes two values: duration (ms), frequency (Hz)");
+      scriptparser_add_sound (self->parser, sound_type_tone, nums, 2);
       }
-    else if ((v = program_context_get (context, VERB_BUZZ)))
+    else
+      log_error 
+         ("--" VERB_TONE " takes two values: duration (ms), frequency (Hz)");
+    }
+  else if ((v = program_context_get (context, VERB_BUZZ)))
+    {
+    int args = program_parse_nums (v, nums, MAX_NUM_ARGS);
+    if (args == 2)
       {
-      int args = program_parse_nums (v, nums);
-      if (args == 2)
-        {
-        program_play_sound (handle, sound_type_buzz, w, volume,
-           nums, 2, period_size); 
-        tonegen_wait (handle);
-        }
-      else
-        log_error 
-           (VERB_BUZZ " takes two values: duration (ms), frequency (Hz)");
+      scriptparser_add_sound (self->parser, sound_type_buzz, nums, 2);
       }
-    else if ((v = program_context_get (context, VERB_NOISE)))
+    else
+      log_error 
+         (VERB_BUZZ " takes two values: duration (ms), frequency (Hz)");
+    }
+  else if ((v = program_context_get (context, VERB_NOISE)))
+    {
+    int args = program_parse_nums (v, nums, MAX_NUM_ARGS);
+    if (args == 1)
       {
-      int args = program_parse_nums (v, nums);
-      if (args == 1)
-        {
-        program_play_sound (handle, sound_type_noise, w, volume,
-           nums, 1, period_size); 
-        tonegen_wait (handle);
-        }
-      else
-        log_error 
-           ("--" VERB_NOISE " takes value: duration (ms)");
+      scriptparser_add_sound (self->parser, sound_type_noise, nums, 1);
       }
-    else if ((v = program_context_get (context, VERB_QUIET)))
+    else
+      log_error 
+         ("--" VERB_NOISE " takes value: duration (ms)");
+    }
+  else if ((v = program_context_get (context, VERB_QUIET)))
+    {
+    int args = program_parse_nums (v, nums, MAX_NUM_ARGS);
+    if (args == 1)
       {
-      int args = program_parse_nums (v, nums);
-      if (args == 1)
-        {
-        program_play_sound (handle, sound_type_silence, w, volume,
-           nums, 1, period_size); 
-        tonegen_wait (handle);
-        }
-      else
-        log_error 
-           ("--" VERB_QUIET " takes value: duration (ms)");
+      scriptparser_add_sound (self->parser, sound_type_silence, nums, 1);
       }
-    else if ((v = program_context_get (context, VERB_SWEEP)))
+    else
+      log_error 
+         ("--" VERB_QUIET " takes value: duration (ms)");
+    }
+  else if ((v = program_context_get (context, VERB_SWEEP)))
+    {
+    int args = program_parse_nums (v, nums, MAX_NUM_ARGS);
+    if (args == 3)
       {
-      int args = program_parse_nums (v, nums);
-      if (args == 3)
-        {
-        program_play_sound (handle, sound_type_sweep, w, volume,
-           nums, 3, period_size); 
-        tonegen_wait (handle);
-        }
-      else
-        log_error 
-           ("--" VERB_SWEEP 
-              " takes three values: duration (ms), start(Hz), end(Hz)");
+      scriptparser_add_sound (self->parser, sound_type_sweep, nums, 3);
+      }
+    else
+      log_error 
+         ("--" VERB_SWEEP 
+            " takes three values: duration (ms), start(Hz), end(Hz)");
+    }
+  else if ((v = program_context_get (context, VERB_RANDOM)))
+    {
+    int args = program_parse_nums (v, nums, MAX_NUM_ARGS);
+    if (args == 4)
+      {
+      scriptparser_add_sound (self->parser, sound_type_random, nums, 4);
       }
-    else if ((v = program_context_get (context, VERB_RANDOM)))
+    else
+      log_error 
+         ("--" VERB_RANDOM 
+      " takes four values: duration (ms), section (ms), start(Hz), end(Hz)");
+    }
+  else if ((v = program_context_get (context, "load-compiled")))
+    {
+    if (!script_load (self->script, v)) return FALSE;
+    }
+  else if ((v = program_context_get (context, "list-file")))
+    {
+    streaming = program_list_file (self, v);
+    }
+  else if ((v = program_context_get (context, VERB_LIST)))
+    {
+    if (strcmp (v, "-") == 0)
       {
-      int args = program_parse_nums (v, nums);
-      if (args == 4)
-        {
-        program_play_sound (handle, sound_type_random, w, volume,
-           nums, 4, period_size); 
-        tonegen_wait (handle);
-        }
-      else
-        log_error 
-           ("--" VERB_RANDOM 
-        " takes four values: duration (ms), section (ms), start(Hz), end(Hz)");
+      // Sounds are played as they arrive
+      eventloop_add_fd (self->loop, STDIN_FILENO, program_stdin_ready, 
+        self);
+      self->input_fd = STDIN_FILENO;
+      streaming = TRUE;
       }
-    else if ((v = program_context_get (context, VERB_LIST)))
+    else
       {
-      program_play_list (handle, v, period_size, w, volume); 
-      tonegen_wait (handle);
+      scriptparser_feed (self->parser, v, strlen (v));
       }
+    }
+
+  if (!streaming) program_list_end (self);
+  return TRUE;
+  }
 
-    snd_pcm_close (handle);
+/*==========================================================================
+  program_compile_all
+  Finish compiling the whole list, without playing any of it, reading
+    all of stdin, or the list file, if necessary
+==========================================================================*/
+static void program_compile_all (Player *self)
+  {
+  if (self->map) program_list_more (self, INT_MAX);
+  if (self->input_fd >= 0)
+    {
+    char buff[4096];
+    int n;
+    while (!scriptparser_is_done (self->parser) 
+        && (n = read (STDIN_FILENO, buff, sizeof (buff))) > 0)
+      scriptparser_feed (self->parser, buff, n);
+    program_list_end (self);
+    }
+  }
+
+/*==========================================================================
+  program_save_compiled
+  Save the compiled list to a file. Nothing is saved if there are 
+    errors in the list
+==========================================================================*/
+static void program_save_compiled (Player *self, const char *filename)
+  {
+  int errors = scriptparser_get_errors (self->parser);
+  if (errors > 0)
+    log_error ("%d error(s) in list -- not saved", errors);
+  else if (script_save (self->script, filename))
+    log_debug ("Saved %d events to %s", 
+      script_length (self->script, script_main), filename);
+  }
+
+/*==========================================================================
+  program_run
+
+  The return value will eventually become the exit value from the program.
+==========================================================================*/
+int program_run (ProgramContext *context)
+  {
+  LOG_IN
+  //char ** const argv = program_context_get_nonswitch_argv (context);
+  //int argc = program_context_get_nonswitch_argc (context);
+
+  // If no seed is given, every run sounds different
+  tonegen_set_seed (program_context_get_int64 (context, "seed", 
+    (int64_t)time (NULL) ^ ((int64_t)getpid() << 32)));
+
+  Waveform w = program_context_get_integer (context, VERB_WAVE, 0);
+  SweepCurve curve = program_context_get_integer (context, VERB_CURVE, 0);
+  int volume = program_context_get_integer (context, VERB_VOLUME, 100);
+
+  WavetableInterp interp = wavetable_interp_linear;
+  const char *s_interp = program_context_get (context, "sine-interp");
+  if (s_interp && !wavetable_parse_interp (s_interp, &interp))
+    log_warning ("Unknown interpolation %s -- using linear", s_interp);
+  int table_size = program_context_get_integer (context, "sine-table", 
+    WAVETABLE_DEFAULT_SIZE);
+  if (!tonegen_set_sine_table (table_size, interp))
+    tonegen_set_sine_table (WAVETABLE_DEFAULT_SIZE, interp);
+
+  const char *kernel = program_context_get (context, "kernel");
+  tonegen_set_kernel (kernel ? kernel : "auto");
+
+  tonegen_set_square_quality (program_context_get_integer (context, 
+    "square-quality", 0));
+
+  RampShape fade = ramp_linear;
+  const char *s_fade = program_context_get (context, "fade");
+  if (s_fade && !ramp_parse_shape (s_fade, &fade))
+    log_warning ("Unknown fade %s -- using linear", s_fade);
+  tonegen_set_fade_shape (fade);
+
+  if (program_context_get_boolean (context, "benchmark", FALSE))
+    {
+    tonegen_benchmark (stdout);
+    tonegen_cleanup ();
+    LOG_OUT
+    return 0;
+    }
+
+  tonegen_set_realtime (program_context_get_boolean (context, "realtime", 
+    FALSE));
+
+  // Zero means use whatever the device prefers
+  tonegen_request_rate (program_context_get_integer (context, "rate", 0));
+  tonegen_request_channels (program_context_get_integer (context, 
+    "channels", 0));
+  const char *route = program_context_get (context, "route");
+  if (route)
+    {
+    int percent [TONEGEN_MAX_CHANNELS];
+    int n = program_parse_nums (route, percent, TONEGEN_MAX_CHANNELS);
+    if (n < 0 || !tonegen_set_route (percent, n))
+      {
+      tonegen_cleanup ();
+      LOG_OUT
+      return 1;
+      }
+    }
+
+  const char *latency = program_context_get (context, "latency");
+  if (latency) tonegen_set_latency (latency);
+  // Times in the RC file and on the command line are in msec
+  tonegen_set_buffering (
+    program_context_get_integer (context, "buffer-time", -1) * 1000,
+    program_context_get_integer (context, "period-time", -1) * 1000,
+    program_context_get_integer (context, "start-threshold", -1) * 1000);
+
+  // The whole list is compiled before the sink is opened, unless it's
+  //   read from stdin or a list file, so that any errors are found 
+  //   before anything is played
+  Player player;
+  program_player_init (&player, w, curve, volume);
+  if (!program_compile (&player, context))
+    {
+    program_player_cleanup (&player);
+    tonegen_cleanup ();
+    LOG_OUT
+    return 1;
+    }
+
+  const char *save = program_context_get (context, "save-compiled");
+  BOOL analyze = program_context_get_boolean (context, "analyze", FALSE);
+  if (save || analyze)
+    {
+    program_compile_all (&player);
+    if (analyze)
+      {
+      int errors = scriptparser_get_errors (player.parser);
+      if (errors > 0) printf ("%d error(s) in list\n", errors);
+      // Without a device, the rate, format, and channels are whatever
+      //   would be asked for
+      int rate = program_context_get_integer (context, "rate", 0);
+      SampleFormat sf = sample_format_s16_le;
+      const char *format = program_context_get (context, "format");
+      if (format) sampleformat_parse (format, &sf);
+      int channels = program_context_get_integer (context, "channels", 1);
+      analyze_script (stdout, player.script, w, 
+        rate > 0 ? rate : SINK_DEFAULT_RATE, 
+        tonegen_get_square_quality (), 
+        sampleformat_get_bytes (sf) * (channels > 0 ? channels : 1));
+      }
+    if (save) program_save_compiled (&player, save);
+    program_player_cleanup (&player);
+    tonegen_cleanup ();
+    LOG_OUT
+    return 0;
+    }
+
+  // An ALSA sink without a target plays on the --device device.
+  //   --output is short for a WAV sink
+  int period_size;
+  const char *device = program_context_get (context, "device"); 
+  if (!device) device = "default";
+  const char *sink = program_context_get (context, "sink"); 
+  const char *output = program_context_get (context, "output"); 
+  char *sink_spec;
+  if (output)
+    {
+    sink_spec = malloc (strlen (output) + 5);
+    sprintf (sink_spec, "wav:%s", output);
+    }
+  else if (!sink || strcmp (sink, "alsa") == 0)
+    {
+    sink_spec = malloc (strlen (device) + 6);
+    sprintf (sink_spec, "alsa:%s", device);
+    }
+  else
+    sink_spec = strdup (sink);
+  const char *format = program_context_get (context, "format"); 
+  int ret = 0;
+  if (tonegen_setup_sound (sink_spec, format, &period_size))
+    {
+    log_debug ("period_size=%d", period_size);
+    double start = bench_now ();
+    program_play (&player);
+    double elapsed = bench_now () - start;
+    if (program_context_get_boolean (context, "stats", FALSE))
+      tonegen_print_stats (stderr);
+    if (output) program_report_render (stderr, elapsed);
     }
   else
     {
     // Error message will already have been displayed
     log_debug ("tonegen_setup_sound failed");
+    ret = 1;
     }
 
+  program_player_cleanup (&player);
+  tonegen_cleanup ();
+  free (sink_spec);
+
   LOG_OUT
-  return 0;
+  return ret;
   }
 
@@ -124,6 +124,30 @@ BOOL program_context_parse_command_line (ProgramContext *self,
       {VERB_LIST, required_argument, NULL, 'l'},
       {VERB_VOLUME, required_argument, NULL, 'v'},
       {VERB_WAVE, required_argument, NULL, 'w'},
+      {VERB_CURVE, required_argument, NULL, 0},
+      {"sine-table", required_argument, NULL, 0},
+      {"sine-interp", required_argument, NULL, 0},
+      {"kernel", required_argument, NULL, 0},
+      {"format", required_argument, NULL, 0},
+      {"seed", required_argument, NULL, 0},
+      {"square-quality", required_argument, NULL, 0},
+      {"analyze", no_argument, NULL, 0},
+      {"benchmark", no_argument, NULL, 0},
+      {"fade", required_argument, NULL, 0},
+      {"latency", required_argument, NULL, 0},
+      {"buffer-time", required_argument, NULL, 0},
+      {"period-time", required_argument, NULL, 0},
+      {"start-threshold", required_argument, NULL, 0},
+      {"stats", no_argument, NULL, 0},
+      {"rate", required_argument, NULL, 0},
+      {"channels", required_argument, NULL, 0},
+      {"route", required_argument, NULL, 0},
+      {"realtime", no_argument, NULL, 0},
+      {"sink", required_argument, NULL, 0},
+      {"output", required_argument, NULL, 0},
+      {"save-compiled", required_argument, NULL, 0},
+      {"load-compiled", required_argument, NULL, 0},
+      {"list-file", required_argument, NULL, 0},
       {0, 0, 0, 0}
     };
 
@@ -167,6 +191,60 @@ BOOL program_context_parse_command_line (ProgramContext *self,
            program_context_put (self, VERB_WAVE, optarg); 
          else if (strcmp (long_options[option_index].name, VERB_VOLUME) == 0)
            program_context_put (self, VERB_VOLUME, optarg); 
+         else if (strcmp (long_options[option_index].name, VERB_CURVE) == 0)
+           program_context_put (self, VERB_CURVE, optarg); 
+         else if (strcmp (long_options[option_index].name, "sine-table") == 0)
+           program_context_put (self, "sine-table", optarg); 
+         else if (strcmp (long_options[option_index].name, "sine-interp") == 0)
+           program_context_put (self, "sine-interp", optarg); 
+         else if (strcmp (long_options[option_index].name, "kernel") == 0)
+           program_context_put (self, "kernel", optarg); 
+         else if (strcmp (long_options[option_index].name, "format") == 0)
+           program_context_put (self, "format", optarg); 
+         else if (strcmp (long_options[option_index].name, "seed") == 0)
+           program_context_put (self, "seed", optarg); 
+         else if (strcmp (long_options[option_index].name, 
+             "square-quality") == 0)
+           program_context_put (self, "square-quality", optarg); 
+         else if (strcmp (long_options[option_index].name, "analyze") == 0)
+           program_context_put_boolean (self, "analyze", TRUE); 
+         else if (strcmp (long_options[option_index].name, "benchmark") == 0)
+           program_context_put_boolean (self, "benchmark", TRUE); 
+         else if (strcmp (long_options[option_index].name, "output") == 0)
+           program_context_put (self, "output", optarg); 
+         else if (strcmp (long_options[option_index].name, 
+             "save-compiled") == 0)
+           program_context_put (self, "save-compiled", optarg); 
+         else if (strcmp (long_options[option_index].name, 
+             "load-compiled") == 0)
+           program_context_put (self, "load-compiled", optarg); 
+         else if (strcmp (long_options[option_index].name, "list-file") == 0)
+           program_context_put (self, "list-file", optarg); 
+         else if (strcmp (long_options[option_index].name, "sink") == 0)
+           program_context_put (self, "sink", optarg); 
+         else if (strcmp (long_options[option_index].name, "stats") == 0)
+           program_context_put_boolean (self, "stats", TRUE); 
+         else if (strcmp (long_options[option_index].name, "rate") == 0)
+           program_context_put (self, "rate", optarg); 
+         else if (strcmp (long_options[option_index].name, "channels") == 0)
+           program_context_put (self, "channels", optarg); 
+         else if (strcmp (long_options[option_index].name, "route") == 0)
+           program_context_put (self, "route", optarg); 
+         else if (strcmp (long_options[option_index].name, "realtime") == 0)
+           program_context_put_boolean (self, "realtime", TRUE); 
+         else if (strcmp (long_options[option_index].name, "fade") == 0)
+           program_context_put (self, "fade", optarg); 
+         else if (strcmp (long_options[option_index].name, "latency") == 0)
+           program_context_put (self, "latency", optarg); 
+         else if (strcmp (long_options[option_index].name, 
+             "buffer-time") == 0)
+           program_context_put (self, "buffer-time", optarg); 
+         else if (strcmp (long_options[option_index].name, 
+             "period-time") == 0)
+           program_context_put (self, "period-time", optarg); 
+         else if (strcmp (long_options[option_index].name, 
+             "start-threshold") == 0)
+           program_context_put (self, "start-threshold", optarg); 
          else
            exit (-1);
          break;
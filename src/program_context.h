@@ -21,6 +21,10 @@ typedef struct _ProgramContext ProgramContext;
 #define VERB_LIST "list"
 #define VERB_WAVE "wave"
 #define VERB_VOLUME "volume"
+#define VERB_CURVE "curve"
+#define VERB_REPEAT "repeat"
+#define VERB_DEFINE "define"
+#define VERB_PLAY "play"
 
 BEGIN_DECLS
 
@@ -0,0 +1,101 @@
+/*==========================================================================
+
+  tonegen 
+  ramp.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  The gain stage, which applies volume and fades to a block of samples,
+  whatever generated it. The gain changes smoothly from a start value
+  to an end value across the block, either linearly or exponentially.
+  Gains are fixed-point, with RAMP_UNITY being full volume; the last
+  sample in the block gets the end gain.
+
+  The linear ramp calculates each sample's gain from its position, 
+  rather than from the previous sample's gain, so the compiler can
+  vectorize the loop. 
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "defs.h" 
+#include "ramp.h" 
+
+/*==========================================================================
+  ramp_apply_linear
+==========================================================================*/
+static void ramp_apply_linear (int16_t *block, int count, int start_gain,
+    int end_gain)
+  {
+  // Gains are held with 15 extra bits of precision, so the step is 
+  //   accurate even for small changes over long blocks. The change is
+  //   negative for a fade, so it's multiplied up rather than shifted.
+  //   Gains are at most RAMP_UNITY, so the results fit in 32 bits, which
+  //   keeps the loop fast
+  int32_t base = (int64_t)start_gain * 32768;
+  int32_t delta = (int64_t)(end_gain - start_gain) * 32768 / count;
+  for (int i = 0; i < count; i++)
+    {
+    int32_t gain = (base + (i + 1) * delta) >> 15;
+    block[i] = (block[i] * gain) >> 15;
+    }
+  }
+
+
+/*==========================================================================
+  ramp_apply_exponential
+  The gain is multiplied by a constant ratio for each sample. The ratio
+    is calculated once per block, and applied in 2.30 fixed point 
+==========================================================================*/
+static void ramp_apply_exponential (int16_t *block, int count, 
+    int start_gain, int end_gain)
+  {
+  if (start_gain < RAMP_EXP_FLOOR) start_gain = RAMP_EXP_FLOOR;
+  if (end_gain < RAMP_EXP_FLOOR) end_gain = RAMP_EXP_FLOOR;
+  uint64_t ratio = pow ((double)end_gain / start_gain, 1.0 / count) 
+    * (1 << 30);
+  uint64_t gain = (uint64_t)start_gain << 15;
+  for (int i = 0; i < count; i++)
+    {
+    gain = (gain * ratio) >> 30;
+    block[i] = (block[i] * (int32_t)(gain >> 15)) >> 15;
+    }
+  }
+
+
+/*==========================================================================
+  ramp_apply
+  Apply gain to the block, changing from start_gain to end_gain. The
+    common case -- full volume, no fade -- costs nothing
+==========================================================================*/
+void ramp_apply (int16_t *block, int count, int start_gain, 
+    int end_gain, RampShape shape)
+  {
+  if (count <= 0) return;
+  if (start_gain == RAMP_UNITY && end_gain == RAMP_UNITY) return;
+  if (shape == ramp_exponential && start_gain != end_gain)
+    ramp_apply_exponential (block, count, start_gain, end_gain);
+  else
+    ramp_apply_linear (block, count, start_gain, end_gain);
+  }
+
+
+/*==========================================================================
+  ramp_parse_shape
+  Convert "linear" or "exponential" to a RampShape. Returns FALSE if
+    the string is neither
+==========================================================================*/
+BOOL ramp_parse_shape (const char *s, RampShape *shape)
+  {
+  if (strcmp (s, "linear") == 0)
+    *shape = ramp_linear;
+  else if (strcmp (s, "exponential") == 0)
+    *shape = ramp_exponential;
+  else
+    return FALSE;
+  return TRUE;
+  }
+
@@ -0,0 +1,30 @@
+/*============================================================================
+
+  tonegen 
+  ramp.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "defs.h"
+
+// Gains are fixed-point, with this value representing unity
+#define RAMP_UNITY 32768
+
+// An exponential curve never reaches zero, so a zero gain at either end
+//   of an exponential ramp is taken to mean this (-60dB) instead
+#define RAMP_EXP_FLOOR 33
+
+// Shape of the change in gain across a block
+typedef enum {ramp_linear=0, ramp_exponential} RampShape;
+
+BEGIN_DECLS
+
+void        ramp_apply (int16_t *block, int count, int start_gain, 
+              int end_gain, RampShape shape);
+BOOL        ramp_parse_shape (const char *s, RampShape *shape);
+
+END_DECLS
@@ -0,0 +1,184 @@
+/*==========================================================================
+
+  tonegen 
+  ringbuffer.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  A ring buffer of audio frames, for passing sound from one thread that 
+  writes to one other thread that reads, without locks. Each side only
+  ever changes its own position, and reads the other's, so the only
+  synchronization needed is that a position is published (release)
+  after the frames it covers have been written or read, and read 
+  (acquire) before those frames are used. Neither side ever waits: 
+  the caller has to arrange to be woken when there is something to do.
+
+  The size is a power of two, so positions can simply count up and 
+  wrap round, and the difference between them is always the number of
+  frames in the buffer. Space is handed out a contiguous piece at a 
+  time, so that sound can be rendered straight into the buffer, and
+  sent straight from it. 
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "defs.h" 
+#include "log.h" 
+#include "ringbuffer.h" 
+
+struct _RingBuffer
+  {
+  BYTE *data;
+  unsigned int size; // Frames, a power of two
+  int frame_bytes;
+  // Positions, in frames, counting up without limit. Each is kept on 
+  //   its own cache line, so that the two threads don't contend for it
+  _Alignas (64) atomic_uint write_pos;
+  _Alignas (64) atomic_uint read_pos;
+  }; 
+
+
+/*==========================================================================
+  ringbuffer_create
+  Create a buffer with room for at least 'frames' frames. Returns NULL
+    if there isn't the memory
+==========================================================================*/
+RingBuffer *ringbuffer_create (int frames, int frame_bytes)
+  {
+  LOG_IN
+  // malloc() needn't give the alignment that the positions ask for
+  RingBuffer *self = aligned_alloc (_Alignof (RingBuffer), 
+    sizeof (RingBuffer));
+  if (!self)
+    {
+    LOG_OUT
+    return NULL;
+    }
+  memset (self, 0, sizeof (RingBuffer));
+  unsigned int size = 1;
+  while (size < (unsigned int)frames) size <<= 1;
+  self->size = size;
+  self->frame_bytes = frame_bytes;
+  self->data = malloc (size * frame_bytes);
+  if (!self->data)
+    {
+    free (self);
+    LOG_OUT
+    return NULL;
+    }
+  atomic_init (&self->write_pos, 0);
+  atomic_init (&self->read_pos, 0);
+  log_debug ("Ring buffer of %u frames", size);
+  LOG_OUT
+  return self;
+  }
+
+
+/*==========================================================================
+  ringbuffer_destroy
+==========================================================================*/
+void ringbuffer_destroy (RingBuffer *self)
+  {
+  LOG_IN
+  if (self)
+    {
+    free (self->data);
+    free (self);
+    }
+  LOG_OUT
+  }
+
+
+/*==========================================================================
+  ringbuffer_write_space
+  Get the number of frames that can be written. Only the writing 
+    thread should call this
+==========================================================================*/
+int ringbuffer_write_space (const RingBuffer *self)
+  {
+  unsigned int w = atomic_load_explicit (&self->write_pos, 
+    memory_order_relaxed);
+  unsigned int r = atomic_load_explicit (&self->read_pos, 
+    memory_order_acquire);
+  return self->size - (w - r);
+  }
+
+
+/*==========================================================================
+  ringbuffer_read_space
+  Get the number of frames waiting to be read. Only the reading thread
+    should call this
+==========================================================================*/
+int ringbuffer_read_space (const RingBuffer *self)
+  {
+  unsigned int w = atomic_load_explicit (&self->write_pos, 
+    memory_order_acquire);
+  unsigned int r = atomic_load_explicit (&self->read_pos, 
+    memory_order_relaxed);
+  return w - r;
+  }
+
+
+/*==========================================================================
+  ringbuffer_write_ptr
+  Get the place to write the next frames, and the number of frames 
+    that can be written there in one piece
+==========================================================================*/
+BYTE *ringbuffer_write_ptr (RingBuffer *self, int *frames)
+  {
+  unsigned int w = atomic_load_explicit (&self->write_pos, 
+    memory_order_relaxed);
+  unsigned int offset = w & (self->size - 1);
+  int space = ringbuffer_write_space (self);
+  int to_end = self->size - offset;
+  *frames = space < to_end ? space : to_end;
+  return self->data + offset * self->frame_bytes;
+  }
+
+
+/*==========================================================================
+  ringbuffer_write_advance
+  Make 'frames' frames, written at ringbuffer_write_ptr(), available 
+    to the reader
+==========================================================================*/
+void ringbuffer_write_advance (RingBuffer *self, int frames)
+  {
+  unsigned int w = atomic_load_explicit (&self->write_pos, 
+    memory_order_relaxed);
+  atomic_store_explicit (&self->write_pos, w + frames, 
+    memory_order_release);
+  }
+
+
+/*==========================================================================
+  ringbuffer_read_ptr
+  Get the next frames to be read, and the number of frames that can 
+    be read from there in one piece
+==========================================================================*/
+const BYTE *ringbuffer_read_ptr (const RingBuffer *self, int *frames)
+  {
+  unsigned int r = atomic_load_explicit (&self->read_pos, 
+    memory_order_relaxed);
+  unsigned int offset = r & (self->size - 1);
+  int waiting = ringbuffer_read_space (self);
+  int to_end = self->size - offset;
+  *frames = waiting < to_end ? waiting : to_end;
+  return self->data + offset * self->frame_bytes;
+  }
+
+
+/*==========================================================================
+  ringbuffer_read_advance
+  Give back 'frames' frames, read from ringbuffer_read_ptr(), to the 
+    writer
+==========================================================================*/
+void ringbuffer_read_advance (RingBuffer *self, int frames)
+  {
+  unsigned int r = atomic_load_explicit (&self->read_pos, 
+    memory_order_relaxed);
+  atomic_store_explicit (&self->read_pos, r + frames, 
+    memory_order_release);
+  }
@@ -0,0 +1,27 @@
+/*============================================================================
+
+  tonegen 
+  ringbuffer.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include "defs.h"
+
+struct _RingBuffer;
+typedef struct _RingBuffer RingBuffer;
+
+BEGIN_DECLS
+
+RingBuffer *ringbuffer_create (int frames, int frame_bytes);
+void        ringbuffer_destroy (RingBuffer *self);
+int         ringbuffer_write_space (const RingBuffer *self);
+int         ringbuffer_read_space (const RingBuffer *self);
+BYTE       *ringbuffer_write_ptr (RingBuffer *self, int *frames);
+void        ringbuffer_write_advance (RingBuffer *self, int frames);
+const BYTE *ringbuffer_read_ptr (const RingBuffer *self, int *frames);
+void        ringbuffer_read_advance (RingBuffer *self, int frames);
+
+END_DECLS
@@ -0,0 +1,104 @@
+/*==========================================================================
+
+  tonegen 
+  rng.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  A small, fast pseudo-random number generator (xorshift64*), for noise
+  and random pitches. Unlike rand(), the state is held by the caller,
+  so the functions are reentrant, and the same seed always produces
+  the same output, whatever else the program is doing. Everything is
+  done with integer operations.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "defs.h" 
+#include "rng.h" 
+
+/*==========================================================================
+  rng_seed
+  Any seed is acceptable, including zero. The seed is scrambled 
+    (splitmix64) so that similar seeds give unrelated sequences, and
+    so the state is never zero, which xorshift can't escape from
+==========================================================================*/
+void rng_seed (Rng *self, uint64_t seed)
+  {
+  uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  z = z ^ (z >> 31);
+  self->state = z ? z : 1;
+  }
+
+
+/*==========================================================================
+  rng_next64
+==========================================================================*/
+static inline uint64_t rng_next64 (Rng *self)
+  {
+  uint64_t x = self->state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  self->state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+  }
+
+
+/*==========================================================================
+  rng_next
+  Get a random 32-bit value. The top half of the 64-bit output is
+    used, because those are the better-quality bits
+==========================================================================*/
+uint32_t rng_next (Rng *self)
+  {
+  return (uint32_t)(rng_next64 (self) >> 32);
+  }
+
+
+/*==========================================================================
+  rng_range
+  Get a random value between lo and hi, inclusive. This uses a multiply
+    and shift, rather than a division or modulus
+==========================================================================*/
+int rng_range (Rng *self, int lo, int hi)
+  {
+  if (hi < lo)
+    {
+    int t = lo; lo = hi; hi = t;
+    }
+  uint64_t span = (uint64_t)((int64_t)hi - lo) + 1;
+  return lo + (int)((rng_next (self) * span) >> 32);
+  }
+
+
+/*==========================================================================
+  rng_fill_noise
+  Fill the block with full-range white noise. Each 64-bit value from
+    the generator provides four samples
+==========================================================================*/
+void rng_fill_noise (Rng *self, int16_t *block, int count)
+  {
+  int i = 0;
+  for (; i + 4 <= count; i += 4)
+    {
+    uint64_t r = rng_next64 (self);
+    block[i] = (int16_t)r;
+    block[i + 1] = (int16_t)(r >> 16);
+    block[i + 2] = (int16_t)(r >> 32);
+    block[i + 3] = (int16_t)(r >> 48);
+    }
+  if (i < count)
+    {
+    uint64_t r = rng_next64 (self);
+    for (; i < count; i++)
+      {
+      block[i] = (int16_t)r;
+      r >>= 16;
+      }
+    }
+  }
+
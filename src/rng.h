@@ -0,0 +1,28 @@
+/*============================================================================
+
+  tonegen 
+  rng.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "defs.h"
+
+// State of one pseudo-random generator. This is small enough to embed
+//   wherever it's needed, so each voice can have its own
+typedef struct _Rng
+  {
+  uint64_t state;
+  } Rng;
+
+BEGIN_DECLS
+
+void     rng_seed (Rng *self, uint64_t seed);
+uint32_t rng_next (Rng *self);
+int      rng_range (Rng *self, int lo, int hi);
+void     rng_fill_noise (Rng *self, int16_t *block, int count);
+
+END_DECLS
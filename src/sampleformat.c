@@ -0,0 +1,234 @@
+/*==========================================================================
+
+  tonegen 
+  sampleformat.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  Functions that convert blocks of generated 16-bit samples to the 
+  format the output device wants. There is one writer for each format,
+  so that the format, sample width, and byte order are all fixed at 
+  compile time, and the loops contain nothing but a store. The writer
+  is chosen once, when the output format has been negotiated.
+
+  For devices with more than one channel, the converted samples are 
+  then spread over the channels of interleaved frames.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "defs.h" 
+#include "log.h" 
+#include "sampleformat.h" 
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define TO_LE16(x) __builtin_bswap16(x)
+#define TO_BE16(x) (x)
+#define TO_LE32(x) __builtin_bswap32(x)
+#else
+#define TO_LE16(x) (x)
+#define TO_BE16(x) __builtin_bswap16(x)
+#define TO_LE32(x) (x)
+#endif
+
+/*==========================================================================
+  sampleformat_write_s16_le
+==========================================================================*/
+static void sampleformat_write_s16_le (void *out, const int16_t *block, 
+    int count)
+  {
+  uint16_t *o = out;
+  for (int i = 0; i < count; i++)
+    o[i] = TO_LE16 ((uint16_t)block[i]);
+  }
+
+/*==========================================================================
+  sampleformat_write_s16_be
+==========================================================================*/
+static void sampleformat_write_s16_be (void *out, const int16_t *block, 
+    int count)
+  {
+  uint16_t *o = out;
+  for (int i = 0; i < count; i++)
+    o[i] = TO_BE16 ((uint16_t)block[i]);
+  }
+
+/*==========================================================================
+  sampleformat_write_s24_3le
+  Three bytes per sample, so there's no way to do aligned stores here
+==========================================================================*/
+static void sampleformat_write_s24_3le (void *out, const int16_t *block, 
+    int count)
+  {
+  BYTE *o = out;
+  for (int i = 0; i < count; i++)
+    {
+    o[0] = 0;
+    o[1] = (BYTE)block[i];
+    o[2] = (BYTE)(block[i] >> 8);
+    o += 3;
+    }
+  }
+
+/*==========================================================================
+  sampleformat_write_s32_le
+==========================================================================*/
+static void sampleformat_write_s32_le (void *out, const int16_t *block, 
+    int count)
+  {
+  uint32_t *o = out;
+  for (int i = 0; i < count; i++)
+    o[i] = TO_LE32 ((uint32_t)block[i] << 16);
+  }
+
+/*==========================================================================
+  sampleformat_write_float_le
+==========================================================================*/
+static void sampleformat_write_float_le (void *out, const int16_t *block, 
+    int count)
+  {
+  uint32_t *o = out;
+  for (int i = 0; i < count; i++)
+    {
+    float f = block[i] * (1.0f / 32768.0f);
+    uint32_t u;
+    memcpy (&u, &f, sizeof (u));
+    o[i] = TO_LE32 (u);
+    }
+  }
+
+// Indexed by SampleFormat
+static const struct 
+  {
+  const char *name;
+  int bytes;
+  SampleWriter writer;
+  } sample_formats[SAMPLE_FORMAT_COUNT] = 
+  {
+  {"S16_LE", 2, sampleformat_write_s16_le},
+  {"S16_BE", 2, sampleformat_write_s16_be},
+  {"S24_3LE", 3, sampleformat_write_s24_3le},
+  {"S32_LE", 4, sampleformat_write_s32_le},
+  {"FLOAT_LE", 4, sampleformat_write_float_le},
+  };
+
+
+/*==========================================================================
+  sampleformat_get_writer
+==========================================================================*/
+SampleWriter sampleformat_get_writer (SampleFormat format)
+  {
+  return sample_formats[format].writer;
+  }
+
+
+/*==========================================================================
+  sampleformat_get_bytes
+  Get the number of bytes occupied by one sample in this format
+==========================================================================*/
+int sampleformat_get_bytes (SampleFormat format)
+  {
+  return sample_formats[format].bytes;
+  }
+
+
+/*==========================================================================
+  sampleformat_get_name
+  Get the name of the format, as ALSA would display it
+==========================================================================*/
+const char *sampleformat_get_name (SampleFormat format)
+  {
+  return sample_formats[format].name;
+  }
+
+
+/*==========================================================================
+  sampleformat_duplicate
+  Copy count samples, already converted to a format of 'bytes' bytes 
+    per sample, from in to every one of 'channels' interleaved channels
+    at out. The common widths have their own loops, so the stores are
+    whole words
+==========================================================================*/
+void sampleformat_duplicate (void *out, const void *in, int count, 
+    int channels, int bytes)
+  {
+  if (bytes == 2)
+    {
+    uint16_t *o = out;
+    const uint16_t *s = in;
+    if (channels == 2)
+      {
+      for (int i = 0; i < count; i++)
+        o[2 * i] = o[2 * i + 1] = s[i];
+      }
+    else
+      {
+      for (int i = 0; i < count; i++, o += channels)
+        for (int c = 0; c < channels; c++)
+          o[c] = s[i];
+      }
+    }
+  else if (bytes == 4)
+    {
+    uint32_t *o = out;
+    const uint32_t *s = in;
+    for (int i = 0; i < count; i++, o += channels)
+      for (int c = 0; c < channels; c++)
+        o[c] = s[i];
+    }
+  else
+    {
+    BYTE *o = out;
+    const BYTE *s = in;
+    for (int i = 0; i < count; i++, s += bytes)
+      for (int c = 0; c < channels; c++, o += bytes)
+        memcpy (o, s, bytes);
+    }
+  }
+
+
+/*==========================================================================
+  sampleformat_store_channel
+  Copy count samples, already converted to a format of 'bytes' bytes
+    per sample, from in to just one channel of the interleaved frames 
+    at out. If in is NULL, the channel is filled with zeros, which is 
+    silence in every format
+==========================================================================*/
+void sampleformat_store_channel (void *out, const void *in, int count, 
+    int channel, int channels, int bytes)
+  {
+  BYTE *o = (BYTE *)out + channel * bytes;
+  int stride = channels * bytes;
+  const BYTE *s = in;
+  for (int i = 0; i < count; i++, o += stride)
+    {
+    if (s)
+      memcpy (o, s + i * bytes, bytes);
+    else
+      memset (o, 0, bytes);
+    }
+  }
+
+
+/*==========================================================================
+  sampleformat_parse
+  Convert an ALSA-style format name, like "S16_LE", to a SampleFormat.
+    Case is not significant. Returns FALSE if the format is not one
+    we can write
+==========================================================================*/
+BOOL sampleformat_parse (const char *s, SampleFormat *format)
+  {
+  for (int i = 0; i < SAMPLE_FORMAT_COUNT; i++)
+    {
+    if (strcasecmp (s, sample_formats[i].name) == 0)
+      {
+      *format = (SampleFormat)i;
+      return TRUE;
+      }
+    }
+  return FALSE;
+  }
+
@@ -0,0 +1,37 @@
+/*============================================================================
+
+  tonegen 
+  sampleformat.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "defs.h"
+
+// Output sample formats that we can write. Generated blocks are always 
+//   16-bit native-endian, and are converted to one of these on output
+typedef enum {sample_format_s16_le=0, sample_format_s16_be, 
+  sample_format_s24_3le, sample_format_s32_le, sample_format_float_le}
+  SampleFormat;
+
+#define SAMPLE_FORMAT_COUNT 5
+
+// A function that converts count 16-bit samples from block, and stores
+//   them at out
+typedef void (*SampleWriter) (void *out, const int16_t *block, int count);
+
+BEGIN_DECLS
+
+SampleWriter sampleformat_get_writer (SampleFormat format);
+int          sampleformat_get_bytes (SampleFormat format);
+const char  *sampleformat_get_name (SampleFormat format);
+BOOL         sampleformat_parse (const char *s, SampleFormat *format);
+void         sampleformat_duplicate (void *out, const void *in, int count, 
+               int channels, int bytes);
+void         sampleformat_store_channel (void *out, const void *in, 
+               int count, int channel, int channels, int bytes);
+
+END_DECLS
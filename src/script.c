@@ -0,0 +1,572 @@
+/*==========================================================================
+
+  tonegen
+  script.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  A compiled list of sounds: a flat array of events, which is played
+  by stepping through it, with no parsing. See scriptparser.c for the
+  compiler.
+
+  Repeats and definitions are played by jumping around the array, 
+  never by copying events, so a block repeated ten thousand times 
+  takes no more memory than one played once. All the state of a 
+  script being played is in a ScriptCursor, of fixed size.
+
+  A script can be saved to a file and loaded again, to skip compiling
+  a large list every time it's played. The file is a header -- the
+  magic "TGSC", a version, and the number of events in each part -- 
+  followed by the events of the definitions part, then the main part,
+  all as 32-bit little-endian integers, so a file can be moved 
+  between machines. Version 1 files, which had no definitions, can
+  still be loaded.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "defs.h"
+#include "log.h"
+#include "tonegen.h"
+#include "script.h"
+
+#define SCRIPT_MAGIC "TGSC"
+#define SCRIPT_VERSION 2
+
+// Number of 32-bit words in a saved event
+#define SCRIPT_EVENT_WORDS (2 + SCRIPT_MAX_VALUES)
+
+// One part of a script. Indexes are counted from the start of the
+//   part, including any events that have been discarded, so they don't
+//   change when events are discarded
+typedef struct _ScriptEvents
+  {
+  ScriptEvent *events;
+  int length;
+  int size;
+  // Number of events discarded from the start
+  int first;
+  } ScriptEvents;
+
+struct _Script
+  {
+  ScriptEvents parts[2];
+  };
+
+
+/*==========================================================================
+  script_create
+==========================================================================*/
+Script *script_create (void)
+  {
+  LOG_IN
+  Script *self = malloc (sizeof (Script));
+  memset (self, 0, sizeof (Script));
+  LOG_OUT
+  return self;
+  }
+
+
+/*==========================================================================
+  script_destroy
+==========================================================================*/
+void script_destroy (Script *self)
+  {
+  LOG_IN
+  if (self)
+    {
+    free (self->parts[script_main].events);
+    free (self->parts[script_defs].events);
+    free (self);
+    }
+  LOG_OUT
+  }
+
+
+/*==========================================================================
+  script_append
+  Add an event to the end of a part, and return its index
+==========================================================================*/
+int script_append (Script *self, ScriptPart part, const ScriptEvent *event)
+  {
+  ScriptEvents *p = &self->parts[part];
+  if (p->length == p->size)
+    {
+    p->size = p->size ? p->size * 2 : 64;
+    p->events = realloc (p->events, p->size * sizeof (ScriptEvent));
+    }
+  p->events[p->length++] = *event;
+  return p->first + p->length - 1;
+  }
+
+
+/*==========================================================================
+  script_patch
+  Replace an event. The compiler uses this to fill in the end of a 
+    repeat, which isn't known until the end of the block
+==========================================================================*/
+void script_patch (Script *self, ScriptPart part, int index, 
+     const ScriptEvent *event)
+  {
+  ScriptEvents *p = &self->parts[part];
+  p->events[index - p->first] = *event;
+  }
+
+
+/*==========================================================================
+  script_length
+  Get the index after the last event of a part
+==========================================================================*/
+int script_length (const Script *self, ScriptPart part)
+  {
+  const ScriptEvents *p = &self->parts[part];
+  return p->first + p->length;
+  }
+
+
+/*==========================================================================
+  script_start
+  Get the index of the first event of the main part that hasn't been
+    discarded
+==========================================================================*/
+int script_start (const Script *self)
+  {
+  return self->parts[script_main].first;
+  }
+
+
+/*==========================================================================
+  script_get
+==========================================================================*/
+const ScriptEvent *script_get (const Script *self, ScriptPart part, 
+     int index)
+  {
+  const ScriptEvents *p = &self->parts[part];
+  return &p->events[index - p->first];
+  }
+
+
+/*==========================================================================
+  script_discard
+  Remove the events of the main part before index -- those that have 
+    already been played, and won't be played again, when a list is 
+    being compiled and played at the same time
+==========================================================================*/
+void script_discard (Script *self, int index)
+  {
+  ScriptEvents *p = &self->parts[script_main];
+  int count = index - p->first;
+  if (count <= 0) return;
+  if (count > p->length) count = p->length;
+  memmove (p->events, p->events + count,
+    (p->length - count) * sizeof (ScriptEvent));
+  p->length -= count;
+  p->first += count;
+  }
+
+
+/*==========================================================================
+  script_put32
+==========================================================================*/
+static BYTE *script_put32 (BYTE *p, uint32_t v)
+  {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+  return p + 4;
+  }
+
+
+/*==========================================================================
+  script_get32
+==========================================================================*/
+static uint32_t script_get32 (const BYTE *p)
+  {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+  }
+
+
+/*==========================================================================
+  script_write_part
+==========================================================================*/
+static BOOL script_write_part (const ScriptEvents *p, FILE *f)
+  {
+  BOOL ok = TRUE;
+  BYTE buff[4 * SCRIPT_EVENT_WORDS];
+  for (int i = 0; i < p->length && ok; i++)
+    {
+    const ScriptEvent *e = &p->events[i];
+    BYTE *b = script_put32 (script_put32 (buff, e->op), e->sound_type);
+    for (int j = 0; j < SCRIPT_MAX_VALUES; j++)
+      b = script_put32 (b, e->values[j]);
+    ok = fwrite (buff, sizeof (buff), 1, f) == 1;
+    }
+  return ok;
+  }
+
+
+/*==========================================================================
+  script_save
+  Write the script to a file. Returns FALSE, having logged the reason,
+    if it can't be written
+==========================================================================*/
+BOOL script_save (const Script *self, const char *filename)
+  {
+  LOG_IN
+  BOOL ret = FALSE;
+  FILE *f = fopen (filename, "wb");
+  if (f)
+    {
+    const ScriptEvents *defs = &self->parts[script_defs];
+    const ScriptEvents *list = &self->parts[script_main];
+    BYTE buff[16];
+    memcpy (buff, SCRIPT_MAGIC, 4);
+    script_put32 (script_put32 (script_put32 (buff + 4, SCRIPT_VERSION), 
+      defs->length), list->length);
+    BOOL ok = fwrite (buff, 16, 1, f) == 1 
+      && script_write_part (defs, f) && script_write_part (list, f);
+    if (fclose (f) != 0) ok = FALSE;
+    if (ok)
+      ret = TRUE;
+    else
+      log_error ("Can't write %s: %s", filename, strerror (errno));
+    }
+  else
+    log_error ("Can't open %s for writing: %s", filename, strerror (errno));
+  LOG_OUT
+  return ret;
+  }
+
+
+/*==========================================================================
+  script_clamp
+==========================================================================*/
+static int32_t script_clamp (int32_t v, int32_t min, int32_t max)
+  {
+  return v < min ? min : v > max ? max : v;
+  }
+
+
+/*==========================================================================
+  script_read_part
+  Read count events, and add them to a part. Jumps must stay within 
+    the events read, and calls must be to one of the defs_count 
+    definitions read, which start at defs_base in this script. Settings
+    are limited to the same ranges the compiler allows. Each loop must
+    close the innermost repeat still open, at the place the repeat 
+    says, and no repeat may be left open at a return or at the end. 
+    Returns FALSE if there are too few events, or any is invalid -- 
+    including a sound with a negative time or frequency
+==========================================================================*/
+static BOOL script_read_part (Script *self, ScriptPart part, FILE *f, 
+     uint32_t count, int defs_base, uint32_t defs_count)
+  {
+  BYTE buff[4 * SCRIPT_EVENT_WORDS];
+  // The repeats that are open, innermost last, by index. The compiler
+  //   never nests them any deeper than this
+  int64_t open[SCRIPT_MAX_DEPTH], close[SCRIPT_MAX_DEPTH];
+  int nopen = 0;
+  for (uint32_t i = 0; i < count; i++)
+    {
+    ScriptEvent e;
+    if (fread (buff, sizeof (buff), 1, f) != 1) return FALSE;
+    e.op = script_get32 (buff);
+    e.sound_type = script_get32 (buff + 4);
+    for (int j = 0; j < SCRIPT_MAX_VALUES; j++)
+      e.values[j] = script_get32 (buff + 8 + 4 * j);
+    BOOL ok;
+    switch (e.op)
+      {
+      case script_op_sound:
+        ok = e.sound_type >= 0 && e.sound_type < SOUND_TYPE_COUNT;
+        for (int j = 0; j < SCRIPT_MAX_VALUES; j++)
+          if (e.values[j] < 0) ok = FALSE;
+        break;
+      case script_op_wave:
+      case script_op_curve:
+        e.values[0] = script_clamp (e.values[0], 0, 1);
+        ok = TRUE;
+        break;
+      case script_op_volume:
+        e.values[0] = script_clamp (e.values[0], 0, 100);
+        ok = TRUE;
+        break;
+      case script_op_repeat:
+        // The loop must come after the repeat
+        ok = e.values[1] >= 2 && e.values[1] <= (int64_t)count - i
+          && nopen < SCRIPT_MAX_DEPTH;
+        if (ok)
+          {
+          open[nopen] = i;
+          close[nopen++] = (int64_t)i + e.values[1] - 1;
+          }
+        break;
+      case script_op_loop:
+        // It must be where the innermost repeat ends, and go back to
+        //   the start of that repeat's body
+        ok = nopen > 0 && close[nopen - 1] == i 
+          && (int64_t)i - e.values[0] == open[nopen - 1] + 1;
+        if (ok) nopen--;
+        break;
+      case script_op_return:
+        ok = nopen == 0;
+        break;
+      case script_op_call:
+        ok = e.values[0] >= 0 && (uint32_t)e.values[0] < defs_count;
+        e.values[0] += defs_base;
+        break;
+      default:
+        ok = e.op > 0 && e.op < SCRIPT_OP_COUNT;
+      }
+    if (!ok) return FALSE;
+    script_append (self, part, &e);
+    }
+  return nopen == 0;
+  }
+
+
+/*==========================================================================
+  script_has_sound
+  Returns TRUE if playing the events from start up to end -- or up to
+    the return that ends a definition -- plays any sound, including in
+    the definitions they call. state holds what is known about each
+    definition: 0 if nothing, 1 if it's being looked at, 2 if it plays
+    a sound, and 3 if not. depth is the number of calls being looked
+    into; deeper calls than can be played are taken to play nothing
+==========================================================================*/
+static BOOL script_has_sound (const Script *self, ScriptPart part, 
+     int start, int end, BYTE *state, int depth)
+  {
+  for (int i = start; i < end; i++)
+    {
+    const ScriptEvent *e = script_get (self, part, i);
+    if (e->op == script_op_sound) return TRUE;
+    if (e->op == script_op_return) return FALSE;
+    if (e->op == script_op_call && depth < SCRIPT_MAX_DEPTH)
+      {
+      int define = e->values[0];
+      if (state[define] == 0)
+        {
+        state[define] = 1;
+        state[define] = script_has_sound (self, script_defs, define, 
+          script_length (self, script_defs), state, depth + 1) ? 2 : 3;
+        }
+      if (state[define] == 2) return TRUE;
+      }
+    }
+  return FALSE;
+  }
+
+
+/*==========================================================================
+  script_limit_repeats
+  Make any repeat, from index start of a part, that plays no sound, 
+    play at most once, as the compiler does. Otherwise it would spin 
+    without making any sound
+==========================================================================*/
+static void script_limit_repeats (Script *self, ScriptPart part, int start,
+     BYTE *state)
+  {
+  int end = script_length (self, part);
+  for (int i = start; i < end; i++)
+    {
+    ScriptEvent e = *script_get (self, part, i);
+    if (e.op == script_op_repeat && e.values[0] > 1 && !script_has_sound 
+        (self, part, i + 1, i + e.values[1] - 1, state, 0))
+      {
+      e.values[0] = 1;
+      script_patch (self, part, i, &e);
+      }
+    }
+  }
+
+
+/*==========================================================================
+  script_load
+  Read a saved script, and add its events to this one. Returns FALSE,
+    having logged the reason, if the file can't be read or isn't a
+    valid script, in which case nothing is added
+==========================================================================*/
+BOOL script_load (Script *self, const char *filename)
+  {
+  LOG_IN
+  BOOL ret = FALSE;
+  FILE *f = fopen (filename, "rb");
+  if (f)
+    {
+    ScriptEvents *defs = &self->parts[script_defs];
+    ScriptEvents *list = &self->parts[script_main];
+    int defs_length = defs->length;
+    int list_length = list->length;
+    BYTE buff[16];
+    if (fread (buff, 12, 1, f) == 1 && memcmp (buff, SCRIPT_MAGIC, 4) == 0)
+      {
+      uint32_t version = script_get32 (buff + 4);
+      uint32_t defs_count = 0, main_count = script_get32 (buff + 8);
+      if (version == 1)
+        ret = TRUE;
+      else if (version == SCRIPT_VERSION && fread (buff, 4, 1, f) == 1)
+        {
+        defs_count = main_count;
+        main_count = script_get32 (buff);
+        ret = TRUE;
+        }
+      int defs_base = script_length (self, script_defs);
+      ret = ret && script_read_part (self, script_defs, f, defs_count, 
+          defs_base, defs_count)
+        && script_read_part (self, script_main, f, main_count, 
+          defs_base, defs_count);
+      }
+    if (ret)
+      {
+      BYTE *state = calloc (script_length (self, script_defs) + 1, 1);
+      script_limit_repeats (self, script_defs, defs_length, state);
+      script_limit_repeats (self, script_main, 
+        script_start (self) + list_length, state);
+      free (state);
+      }
+    else
+      {
+      log_error ("%s is not a valid compiled list", filename);
+      defs->length = defs_length;
+      list->length = list_length;
+      }
+    fclose (f);
+    }
+  else
+    log_error ("Can't open %s: %s", filename, strerror (errno));
+  LOG_OUT
+  return ret;
+  }
+
+
+/*==========================================================================
+  script_cursor_init
+  Set a cursor to the start of the main part
+==========================================================================*/
+void script_cursor_init (ScriptCursor *cursor)
+  {
+  memset (cursor, 0, sizeof (ScriptCursor));
+  cursor->part = script_main;
+  }
+
+
+/*==========================================================================
+  script_cursor_oldest
+  Get the earliest event of the main part that the cursor can still 
+    go back to -- the start of a repeat, or the event after a call.
+    Events before this can be discarded
+==========================================================================*/
+int script_cursor_oldest (const ScriptCursor *cursor)
+  {
+  int oldest = cursor->part == script_main ? cursor->pc : INT32_MAX;
+  for (int i = 0; i < cursor->depth; i++)
+    {
+    const ScriptFrame *frame = &cursor->frames[i];
+    if (frame->part == script_main && frame->pc < oldest) 
+      oldest = frame->pc;
+    }
+  return oldest;
+  }
+
+
+/*==========================================================================
+  script_return
+  Go back to the event after the latest call, dropping any repeats
+    that are still in progress in between. Returns FALSE if there is
+    no call to return from
+==========================================================================*/
+static BOOL script_return (ScriptCursor *cursor)
+  {
+  while (cursor->depth > 0)
+    {
+    ScriptFrame *frame = &cursor->frames[--cursor->depth];
+    if (frame->is_call)
+      {
+      cursor->part = frame->part;
+      cursor->pc = frame->pc;
+      return TRUE;
+      }
+    }
+  return FALSE;
+  }
+
+
+/*==========================================================================
+  script_next
+  Get the next sound or setting to play, following repeats and calls,
+    and move the cursor past it. Returns NULL at the end of the script, 
+    or if the cursor reaches limit in the main part -- so the events
+    of a block that is still being compiled aren't played
+==========================================================================*/
+const ScriptEvent *script_next (const Script *self, ScriptCursor *cursor, 
+     int limit)
+  {
+  for (;;)
+    {
+    if (cursor->part == script_main)
+      {
+      int length = script_length (self, script_main);
+      if (cursor->pc >= limit || cursor->pc >= length) return NULL;
+      }
+    else if (cursor->pc >= script_length (self, script_defs))
+      {
+      // Shouldn't happen -- every definition ends with a return
+      if (!script_return (cursor)) return NULL;
+      continue;
+      }
+
+    int index = cursor->pc++;
+    const ScriptEvent *e = script_get (self, cursor->part, index);
+    ScriptFrame *frame = cursor->depth > 0 
+      ? &cursor->frames[cursor->depth - 1] : NULL;
+    switch (e->op)
+      {
+      case script_op_repeat:
+        if (e->values[0] > 0 && cursor->depth < SCRIPT_MAX_DEPTH)
+          {
+          frame = &cursor->frames[cursor->depth++];
+          frame->is_call = FALSE;
+          frame->part = cursor->part;
+          frame->pc = cursor->pc;
+          frame->remaining = e->values[0];
+          }
+        else
+          cursor->pc = index + e->values[1];
+        break;
+
+      case script_op_loop:
+        // The repeat this ends must be the one in progress
+        if (frame && !frame->is_call && frame->part == cursor->part
+            && frame->pc == index - e->values[0])
+          {
+          if (--frame->remaining > 0)
+            cursor->pc = frame->pc;
+          else
+            cursor->depth--;
+          }
+        break;
+
+      case script_op_call:
+        if (cursor->depth < SCRIPT_MAX_DEPTH)
+          {
+          frame = &cursor->frames[cursor->depth++];
+          frame->is_call = TRUE;
+          frame->part = cursor->part;
+          frame->pc = cursor->pc;
+          cursor->part = script_defs;
+          cursor->pc = e->values[0];
+          }
+        break;
+
+      case script_op_return:
+        script_return (cursor);
+        break;
+
+      default:
+        return e;
+      }
+    }
+  }
+
@@ -0,0 +1,96 @@
+/*============================================================================
+
+  tonegen
+  script.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "defs.h"
+
+// Most values that an event carries
+#define SCRIPT_MAX_VALUES 4
+
+// Most repeats and calls that can be in progress at once
+#define SCRIPT_MAX_DEPTH 32
+
+// What an event does. A sound event plays a sound, using the waveform,
+//   curve, and volume set by the setting events before it. The others
+//   are handled by script_next, and never seen by the player
+typedef enum {script_op_sound=0, script_op_wave, script_op_volume,
+  script_op_curve, script_op_repeat, script_op_loop, script_op_call,
+  script_op_return} ScriptOp;
+
+#define SCRIPT_OP_COUNT 8
+
+// A script has two parts. The main part is what is played; the
+//   definitions part holds the bodies of definitions, which the main
+//   part calls. Only the main part is discarded as it is played
+typedef enum {script_main=0, script_defs} ScriptPart;
+
+// One step of a compiled list. For a sound, sound_type is a SoundType,
+//   and the values are the duration and sub-duration in msec, and the
+//   two frequencies in Hz, with zero for any that the sound doesn't
+//   use. For a setting, values[0] is the new setting.
+// A repeat has the count, and the distance to the event after its
+//   loop; a loop has the distance back to the start of the body. A
+//   call has the index of a definition in the definitions part, which
+//   ends with a return. Events contain no pointers, so they can be
+//   saved and loaded as they are
+typedef struct _ScriptEvent
+  {
+  int32_t op;
+  int32_t sound_type;
+  int32_t values[SCRIPT_MAX_VALUES];
+  } ScriptEvent;
+
+// A repeat or call in progress. For a repeat, part and pc are the
+//   start of the body; for a call, the event to return to
+typedef struct _ScriptFrame
+  {
+  BOOL is_call;
+  ScriptPart part;
+  int pc;
+  int remaining;
+  } ScriptFrame;
+
+// Where a script is being played from. This is all the state needed
+//   to play a script, however many repeats and calls it has, so
+//   playing takes no memory beyond the script itself
+typedef struct _ScriptCursor
+  {
+  ScriptPart part;
+  int pc;
+  int depth;
+  ScriptFrame frames[SCRIPT_MAX_DEPTH];
+  } ScriptCursor;
+
+struct _Script;
+typedef struct _Script Script;
+
+BEGIN_DECLS
+
+Script            *script_create (void);
+void               script_destroy (Script *self);
+int                script_append (Script *self, ScriptPart part,
+                     const ScriptEvent *event);
+void               script_patch (Script *self, ScriptPart part, int index,
+                     const ScriptEvent *event);
+int                script_length (const Script *self, ScriptPart part);
+int                script_start (const Script *self);
+const ScriptEvent *script_get (const Script *self, ScriptPart part,
+                     int index);
+void               script_discard (Script *self, int index);
+BOOL               script_save (const Script *self, const char *filename);
+BOOL               script_load (Script *self, const char *filename);
+
+void               script_cursor_init (ScriptCursor *cursor);
+int                script_cursor_oldest (const ScriptCursor *cursor);
+const ScriptEvent *script_next (const Script *self, ScriptCursor *cursor,
+                     int limit);
+
+END_DECLS
+
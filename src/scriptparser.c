@@ -0,0 +1,754 @@
+/*==========================================================================
+
+  tonegen
+  scriptparser.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  Compiles the text of a list into a Script. The text can be given a
+  piece at a time, divided anywhere -- even in the middle of a word --
+  and each entry is added to the script as soon as it has all its
+  values, so a list that is still arriving can be played as it is
+  compiled. Nothing is copied except the word in progress, so there is
+  no limit to the length of a list, or of a line within it.
+
+  All checking of values is done here, so that a complete list can be
+  checked before any of it is played.
+
+  "repeat N { ... }" compiles to a repeat event, the body, and a loop
+  event that goes back to the start of the body. "define name { ... }"
+  compiles the body into the definitions part of the script, ending
+  with a return, and "play name" compiles to a call. So nothing is 
+  ever copied, however many times it is played. Blocks nest, but 
+  definitions can't be inside other blocks, and a name has to be 
+  defined before it is played, so a definition can't play itself.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "log.h"
+#include "numberformat.h"
+#include "program_context.h"
+#include "tonegen.h"
+#include "script.h"
+#include "scriptparser.h"
+
+// Largest number of values collected for one entry. Extra values are
+//   counted, so that the entry can be rejected, but not stored
+#define MAX_VALUES 10
+
+// Longest word in a list. Nothing valid is anywhere near this long
+#define MAX_WORD_LEN 31
+
+// List verbs that change settings, or start blocks, rather than play 
+//   sounds. These share a number space with SoundType
+typedef enum {list_verb_wave=100, list_verb_volume, list_verb_curve,
+  list_verb_repeat} ListVerbType;
+
+// What the next word has to be, after a word that needs a name or a
+//   block to follow it
+typedef enum {expect_any=0, expect_define_name, expect_play_name, 
+  expect_repeat_open, expect_define_open} Expect;
+
+// A block that is being compiled. start is the index of the repeat
+//   event, or of the first event of a definition
+typedef struct _Block
+  {
+  BOOL is_define;
+  int start;
+  int count;
+  BOOL has_sound;
+  } Block;
+
+// A name that can be played. depth is the number of repeats and calls
+//   that playing it needs, including its own call
+typedef struct _Define
+  {
+  char name[MAX_WORD_LEN + 1];
+  int start;
+  int depth;
+  BOOL has_sound;
+  } Define;
+
+// A word that can start an entry in a list, and the number of values
+//   that follow it. type is a SoundType or a ListVerbType
+typedef struct _ListVerb
+  {
+  const char *name;
+  int type;
+  int args;
+  } ListVerb;
+
+static const ListVerb list_verbs[] =
+  {
+  {VERB_TONE, sound_type_tone, 2},
+  {VERB_NOISE, sound_type_noise, 1},
+  {VERB_BUZZ, sound_type_buzz, 2},
+  {VERB_QUIET, sound_type_silence, 1},
+  {VERB_RANDOM, sound_type_random, 4},
+  {VERB_SWEEP, sound_type_sweep, 3},
+  {VERB_WAVE, list_verb_wave, 1},
+  {VERB_VOLUME, list_verb_volume, 1},
+  {VERB_CURVE, list_verb_curve, 1},
+  {VERB_REPEAT, list_verb_repeat, 1},
+  };
+
+struct _ScriptParser
+  {
+  Script *script;
+  // The verb being parsed, if any, and its values so far
+  const ListVerb *verb;
+  int nums[MAX_VALUES];
+  int args;
+  // The word being read, which may be split between pieces of text
+  char word[MAX_WORD_LEN + 1];
+  int word_len;
+  // What the next word has to be, and the repeat count or name 
+  //   that is waiting for it
+  Expect expect;
+  int count;
+  char name[MAX_WORD_LEN + 1];
+  // The blocks being compiled, outermost first. A definition can only
+  //   be the outermost
+  Block blocks[SCRIPT_MAX_DEPTH];
+  int nblocks;
+  // Most repeats and calls needed by the definition being compiled
+  int define_depth;
+  Define *defines;
+  int ndefines;
+  // Set by "stop", or at the end of the text. Anything after this
+  //   is ignored
+  BOOL done;
+  int errors;
+  };
+
+
+/*==========================================================================
+  scriptparser_create
+  Create a parser that adds to script
+==========================================================================*/
+ScriptParser *scriptparser_create (Script *script)
+  {
+  LOG_IN
+  ScriptParser *self = malloc (sizeof (ScriptParser));
+  memset (self, 0, sizeof (ScriptParser));
+  self->script = script;
+  LOG_OUT
+  return self;
+  }
+
+
+/*==========================================================================
+  scriptparser_destroy
+==========================================================================*/
+void scriptparser_destroy (ScriptParser *self)
+  {
+  LOG_IN
+  free (self->defines);
+  free (self);
+  LOG_OUT
+  }
+
+
+/*==========================================================================
+  scriptparser_find_verb
+  Get the list verb with the given name, or NULL if there isn't one
+==========================================================================*/
+static const ListVerb *scriptparser_find_verb (const char *name)
+  {
+  int n = sizeof (list_verbs) / sizeof (ListVerb);
+  for (int i = 0; i < n; i++)
+    if (strcmp (list_verbs[i].name, name) == 0) return &list_verbs[i];
+  return NULL;
+  }
+
+
+/*==========================================================================
+  scriptparser_in_define
+==========================================================================*/
+static BOOL scriptparser_in_define (const ScriptParser *self)
+  {
+  return self->nblocks > 0 && self->blocks[0].is_define;
+  }
+
+
+/*==========================================================================
+  scriptparser_append
+  Add an event to the part of the script being compiled, and return
+    its index
+==========================================================================*/
+static int scriptparser_append (ScriptParser *self, const ScriptEvent *e)
+  {
+  return script_append (self->script, scriptparser_in_define (self) 
+    ? script_defs : script_main, e);
+  }
+
+
+/*==========================================================================
+  scriptparser_add_sound
+  Check the values for a sound and, if they're right, add it to the
+    script. Returns FALSE, having logged the reason, if not
+==========================================================================*/
+BOOL scriptparser_add_sound (ScriptParser *self, SoundType sound_type,
+     const int *nums, int args)
+  {
+  ScriptEvent e;
+  memset (&e, 0, sizeof (e));
+  e.op = script_op_sound;
+  e.sound_type = sound_type;
+  BOOL ok = FALSE;
+  switch (sound_type)
+    {
+    case sound_type_tone:
+    case sound_type_buzz:
+      if (args == 2)
+        {
+        e.values[0] = nums[0];
+        e.values[2] = nums[1];
+        ok = TRUE;
+        }
+      else if (sound_type == sound_type_tone)
+        log_error
+           (VERB_TONE " takes two values: duration (ms), frequency (Hz)");
+      else
+        log_error
+           (VERB_BUZZ " takes two values: duration (ms), frequency (Hz)");
+      break;
+
+    case sound_type_noise:
+    case sound_type_silence:
+      if (args == 1)
+        {
+        e.values[0] = nums[0];
+        ok = TRUE;
+        }
+      else if (sound_type == sound_type_noise)
+        log_error
+           (VERB_NOISE " takes value: duration (ms)");
+      else
+        log_error
+           (VERB_QUIET " takes value: duration (ms)");
+      break;
+
+    case sound_type_sweep:
+      if (args == 3)
+        {
+        e.values[0] = nums[0];
+        e.values[2] = nums[1];
+        e.values[3] = nums[2];
+        ok = TRUE;
+        }
+      else
+        log_error
+           (VERB_SWEEP
+             " takes three values: duration (ms), start(Hz), end(Hz)");
+       break;
+
+    case sound_type_random:
+      if (args == 4)
+        {
+        e.values[0] = nums[0];
+        e.values[1] = nums[1];
+        e.values[2] = nums[2];
+        e.values[3] = nums[3];
+        ok = TRUE;
+        }
+      else
+        log_error
+           (VERB_RANDOM " takes four values: duration (ms), section (ms), "
+             "min(Hz), max(Hz)");
+      break;
+    }
+
+  for (int i = 0; ok && i < SCRIPT_MAX_VALUES; i++)
+    {
+    if (e.values[i] < 0)
+      {
+      log_error ("Times and frequencies can't be negative");
+      ok = FALSE;
+      }
+    }
+
+  if (ok)
+    {
+    scriptparser_append (self, &e);
+    if (self->nblocks > 0) self->blocks[self->nblocks - 1].has_sound = TRUE;
+    }
+  else
+    self->errors++;
+  return ok;
+  }
+
+
+/*==========================================================================
+  scriptparser_add_setting
+==========================================================================*/
+static void scriptparser_add_setting (ScriptParser *self, ScriptOp op,
+     int value)
+  {
+  ScriptEvent e;
+  memset (&e, 0, sizeof (e));
+  e.op = op;
+  e.values[0] = value;
+  scriptparser_append (self, &e);
+  }
+
+
+/*==========================================================================
+  scriptparser_dispatch
+  Compile the verb that has just been parsed, with whatever values it
+    has collected, and clear it
+==========================================================================*/
+static void scriptparser_dispatch (ScriptParser *self)
+  {
+  const ListVerb *verb = self->verb;
+  int args = self->args;
+  log_debug ("got %d args, verb %s", args, verb->name);
+  self->verb = NULL;
+  if (verb->type == list_verb_wave)
+    {
+    if (args == 1)
+      scriptparser_add_setting (self, script_op_wave, 
+        self->nums[0] ? waveform_square : waveform_sine);
+    else
+      {
+      log_error (VERB_WAVE " takes one argument -- 0 or 1");
+      self->errors++;
+      }
+    }
+  else if (verb->type == list_verb_volume)
+    {
+    if (args == 1)
+      {
+      int vol = self->nums[0];
+      if (vol > 100) vol = 100;
+      if (vol < 0) vol = 0;
+      scriptparser_add_setting (self, script_op_volume, vol);
+      }
+    else
+      {
+      log_error (VERB_VOLUME " takes one argument -- 0 to 100");
+      self->errors++;
+      }
+    }
+  else if (verb->type == list_verb_curve)
+    {
+    if (args == 1)
+      scriptparser_add_setting (self, script_op_curve, 
+        self->nums[0] ? sweep_curve_exponential : sweep_curve_linear);
+    else
+      {
+      log_error (VERB_CURVE " takes one argument -- 0 or 1");
+      self->errors++;
+      }
+    }
+  else if (verb->type == list_verb_repeat)
+    {
+    if (args == 1)
+      {
+      self->count = self->nums[0];
+      self->expect = expect_repeat_open;
+      }
+    else
+      {
+      log_error (VERB_REPEAT " takes one value: the number of times");
+      self->errors++;
+      }
+    }
+  else
+    scriptparser_add_sound (self, verb->type, self->nums, args);
+  }
+
+
+/*==========================================================================
+  scriptparser_give_up
+  Log an error in the structure of the list, which would make anything
+    after it meaningless, and ignore the rest of the list
+==========================================================================*/
+static void scriptparser_give_up (ScriptParser *self, const char *msg)
+  {
+  log_error ("%s -- ignoring the rest of the list", msg);
+  self->errors++;
+  self->done = TRUE;
+  }
+
+
+/*==========================================================================
+  scriptparser_open_block
+  Start the repeat or definition that is waiting for "{"
+==========================================================================*/
+static void scriptparser_open_block (ScriptParser *self)
+  {
+  BOOL is_define = self->expect == expect_define_open;
+  self->expect = expect_any;
+  if (self->nblocks == SCRIPT_MAX_DEPTH)
+    {
+    scriptparser_give_up (self, "Blocks are nested too deeply");
+    return;
+    }
+  Block *block = &self->blocks[self->nblocks];
+  memset (block, 0, sizeof (Block));
+  block->is_define = is_define;
+  if (is_define)
+    {
+    block->start = script_length (self->script, script_defs);
+    self->define_depth = 1;
+    }
+  else
+    {
+    ScriptEvent e;
+    memset (&e, 0, sizeof (e));
+    e.op = script_op_repeat;
+    e.values[0] = self->count;
+    block->start = scriptparser_append (self, &e);
+    block->count = self->count;
+    }
+  self->nblocks++;
+  // Each block is one repeat or call in progress when it's played
+  if (self->nblocks > self->define_depth) self->define_depth = self->nblocks;
+  }
+
+
+/*==========================================================================
+  scriptparser_close_block
+  End the innermost block
+==========================================================================*/
+static void scriptparser_close_block (ScriptParser *self)
+  {
+  ScriptEvent e;
+  memset (&e, 0, sizeof (e));
+  Block *block = &self->blocks[self->nblocks - 1];
+  if (block->is_define)
+    {
+    e.op = script_op_return;
+    scriptparser_append (self, &e);
+    self->defines = realloc (self->defines, 
+      (self->ndefines + 1) * sizeof (Define));
+    Define *define = &self->defines[self->ndefines++];
+    strcpy (define->name, self->name);
+    define->start = block->start;
+    define->depth = self->define_depth;
+    define->has_sound = block->has_sound;
+    self->nblocks--;
+    return;
+    }
+
+  e.op = script_op_loop;
+  int loop = scriptparser_append (self, &e);
+  e.values[0] = loop - (block->start + 1);
+  script_patch (self->script, scriptparser_in_define (self) 
+    ? script_defs : script_main, loop, &e);
+
+  // A repeat with no sounds would spin without making any sound, 
+  //   and playing its settings once has the same effect as playing
+  //   them many times
+  e.op = script_op_repeat;
+  e.values[0] = block->count;
+  if (!block->has_sound && block->count > 1) e.values[0] = 1;
+  e.values[1] = loop + 1 - block->start;
+  script_patch (self->script, scriptparser_in_define (self) 
+    ? script_defs : script_main, block->start, &e);
+
+  BOOL has_sound = block->has_sound;
+  self->nblocks--;
+  if (self->nblocks > 0 && has_sound) 
+    self->blocks[self->nblocks - 1].has_sound = TRUE;
+  }
+
+
+/*==========================================================================
+  scriptparser_find_define
+  Get the latest definition with the given name, or NULL if there 
+    isn't one
+==========================================================================*/
+static const Define *scriptparser_find_define (const ScriptParser *self,
+     const char *name)
+  {
+  for (int i = self->ndefines - 1; i >= 0; i--)
+    if (strcmp (self->defines[i].name, name) == 0) return &self->defines[i];
+  return NULL;
+  }
+
+
+/*==========================================================================
+  scriptparser_play
+  Compile a call to a definition
+==========================================================================*/
+static void scriptparser_play (ScriptParser *self, const char *name)
+  {
+  const Define *define = scriptparser_find_define (self, name);
+  if (!define)
+    {
+    log_error ("%s has not been defined", name);
+    self->errors++;
+    }
+  else if (self->nblocks + define->depth > SCRIPT_MAX_DEPTH)
+    {
+    log_error ("Can't play %s here -- blocks are nested too deeply", name);
+    self->errors++;
+    }
+  else
+    {
+    ScriptEvent e;
+    memset (&e, 0, sizeof (e));
+    e.op = script_op_call;
+    e.values[0] = define->start;
+    scriptparser_append (self, &e);
+    int depth = self->nblocks + define->depth;
+    if (depth > self->define_depth) self->define_depth = depth;
+    if (self->nblocks > 0 && define->has_sound) 
+      self->blocks[self->nblocks - 1].has_sound = TRUE;
+    }
+  }
+
+
+/*==========================================================================
+  scriptparser_is_keyword
+  Returns TRUE if the word has a meaning of its own in a list, and so
+    can't be a name
+==========================================================================*/
+static BOOL scriptparser_is_keyword (const char *word)
+  {
+  return scriptparser_find_verb (word) || strcmp (word, "stop") == 0
+    || strcmp (word, VERB_DEFINE) == 0 || strcmp (word, VERB_PLAY) == 0
+    || strcmp (word, "{") == 0 || strcmp (word, "}") == 0;
+  }
+
+
+/*==========================================================================
+  scriptparser_name
+  Handle the name after "define" or "play". Returns FALSE if the word
+    isn't a name, in which case it still has to be parsed
+==========================================================================*/
+static BOOL scriptparser_name (ScriptParser *self, const char *tok)
+  {
+  BOOL is_define = self->expect == expect_define_name;
+  self->expect = expect_any;
+  if (scriptparser_is_keyword (tok) || !((tok[0] >= 'a' && tok[0] <= 'z')
+      || (tok[0] >= 'A' && tok[0] <= 'Z') || tok[0] == '_'))
+    {
+    log_error ("%s needs a name, not %s", 
+      is_define ? VERB_DEFINE : VERB_PLAY, tok);
+    self->errors++;
+    return FALSE;
+    }
+  if (is_define)
+    {
+    strcpy (self->name, tok);
+    self->expect = expect_define_open;
+    }
+  else
+    scriptparser_play (self, tok);
+  return TRUE;
+  }
+
+
+/*==========================================================================
+  scriptparser_token
+  Parse one word of a list. A verb is compiled as soon as it has all
+    its values, so a sound can start playing before the rest of the
+    list has arrived
+==========================================================================*/
+static void scriptparser_token (ScriptParser *self, const char *tok)
+  {
+  log_debug ("tok=%s", tok);
+  if (self->done) return;
+  if (self->expect == expect_define_name || self->expect == expect_play_name)
+    {
+    if (scriptparser_name (self, tok)) return;
+    }
+  if (strcmp (tok, "{") == 0)
+    {
+    if (self->verb) scriptparser_dispatch (self);
+    if (self->expect == expect_repeat_open 
+        || self->expect == expect_define_open)
+      scriptparser_open_block (self);
+    else
+      {
+      log_error ("{ must follow " VERB_REPEAT " N or " VERB_DEFINE " name");
+      self->errors++;
+      }
+    return;
+    }
+  if (self->expect != expect_any)
+    {
+    log_error ("%s must be followed by {", self->expect == expect_repeat_open 
+      ? VERB_REPEAT " N" : VERB_DEFINE " name");
+    self->errors++;
+    self->expect = expect_any;
+    }
+  if (strcmp (tok, "}") == 0)
+    {
+    if (self->verb) scriptparser_dispatch (self);
+    if (self->nblocks > 0)
+      scriptparser_close_block (self);
+    else
+      {
+      log_error ("} without {");
+      self->errors++;
+      }
+    return;
+    }
+  if (strcmp (tok, VERB_DEFINE) == 0 || strcmp (tok, VERB_PLAY) == 0)
+    {
+    if (self->verb) scriptparser_dispatch (self);
+    if (strcmp (tok, VERB_PLAY) == 0)
+      self->expect = expect_play_name;
+    else if (self->nblocks > 0)
+      scriptparser_give_up (self, VERB_DEFINE " can't be inside a block");
+    else
+      self->expect = expect_define_name;
+    return;
+    }
+  const ListVerb *verb = scriptparser_find_verb (tok);
+  if (verb || strcmp (tok, "stop") == 0)
+    {
+    // A verb before the previous one has all its values
+    if (self->verb) scriptparser_dispatch (self);
+    if (verb)
+      {
+      self->verb = verb;
+      self->args = 0;
+      }
+    else
+      self->done = TRUE;
+    }
+  else if (!self->verb)
+    {
+    log_error ("%s is neither a sound type nor a number", tok);
+    self->errors++;
+    }
+  else
+    {
+    uint64_t v;
+    if (numberformat_read_integer (tok, &v, TRUE))
+      {
+      if (self->args < MAX_VALUES)
+        self->nums[self->args] = v;
+      self->args++;
+      if (self->args == self->verb->args) scriptparser_dispatch (self);
+      }
+    else
+      {
+      log_warning ("%s is neither a sound type nor a number", tok);
+      self->errors++;
+      }
+    }
+  }
+
+
+/*==========================================================================
+  scriptparser_word_end
+  Parse the word that has been collected, if there is one
+==========================================================================*/
+static void scriptparser_word_end (ScriptParser *self)
+  {
+  if (self->word_len == 0) return;
+  if (self->word_len > MAX_WORD_LEN)
+    {
+    log_warning ("Word beginning %s is too long -- ignoring it",
+      self->word);
+    self->errors++;
+    }
+  else
+    scriptparser_token (self, self->word);
+  self->word_len = 0;
+  }
+
+
+/*==========================================================================
+  scriptparser_feed
+  Compile len characters of a list
+==========================================================================*/
+void scriptparser_feed (ScriptParser *self, const char *text, int len)
+  {
+  for (int i = 0; i < len && !self->done; i++)
+    {
+    char c = text[i];
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',')
+      scriptparser_word_end (self);
+    else if (c == '{' || c == '}')
+      {
+      // Braces are words, even with no space around them
+      char brace[2] = {c, 0};
+      scriptparser_word_end (self);
+      scriptparser_token (self, brace);
+      }
+    else
+      {
+      // Only the start of an over-long word is kept
+      if (self->word_len < MAX_WORD_LEN)
+        {
+        self->word[self->word_len] = c;
+        self->word[self->word_len + 1] = 0;
+        }
+      self->word_len++;
+      }
+    }
+  }
+
+
+/*==========================================================================
+  scriptparser_finish
+  Compile whatever is left at the end of the text -- the last word,
+    and the last verb, if it's short of values -- and close any 
+    blocks that are still open, so that they can be played. Nothing 
+    more is compiled after this
+==========================================================================*/
+void scriptparser_finish (ScriptParser *self)
+  {
+  scriptparser_word_end (self);
+  if (self->verb) scriptparser_dispatch (self);
+  if (!self->done && self->expect != expect_any)
+    {
+    log_error ("List ends without a block after " VERB_REPEAT " or " 
+      VERB_DEFINE);
+    self->errors++;
+    }
+  if (!self->done && self->nblocks > 0)
+    {
+    log_error ("List ends without }");
+    self->errors++;
+    }
+  while (self->nblocks > 0) scriptparser_close_block (self);
+  self->done = TRUE;
+  }
+
+
+/*==========================================================================
+  scriptparser_get_complete
+  Get the index after the last event of the main part of the script
+    that can be played -- all of it, unless a repeat is still being
+    compiled
+==========================================================================*/
+int scriptparser_get_complete (const ScriptParser *self)
+  {
+  if (self->nblocks > 0 && !self->blocks[0].is_define)
+    return self->blocks[0].start;
+  return script_length (self->script, script_main);
+  }
+
+
+/*==========================================================================
+  scriptparser_is_done
+  Returns TRUE once "stop" has been found, or scriptparser_finish has
+    been called
+==========================================================================*/
+BOOL scriptparser_is_done (const ScriptParser *self)
+  {
+  return self->done;
+  }
+
+
+/*==========================================================================
+  scriptparser_get_errors
+  Get the number of errors found so far, all of which have been logged
+==========================================================================*/
+int scriptparser_get_errors (const ScriptParser *self)
+  {
+  return self->errors;
+  }
+
@@ -0,0 +1,32 @@
+/*============================================================================
+
+  tonegen
+  scriptparser.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include "defs.h"
+#include "tonegen.h"
+#include "script.h"
+
+struct _ScriptParser;
+typedef struct _ScriptParser ScriptParser;
+
+BEGIN_DECLS
+
+ScriptParser *scriptparser_create (Script *script);
+void          scriptparser_destroy (ScriptParser *self);
+void          scriptparser_feed (ScriptParser *self, const char *text,
+                int len);
+void          scriptparser_finish (ScriptParser *self);
+BOOL          scriptparser_is_done (const ScriptParser *self);
+int           scriptparser_get_complete (const ScriptParser *self);
+int           scriptparser_get_errors (const ScriptParser *self);
+BOOL          scriptparser_add_sound (ScriptParser *self,
+                SoundType sound_type, const int *nums, int args);
+
+END_DECLS
+
@@ -0,0 +1,229 @@
+/*==========================================================================
+
+  tonegen 
+  sink.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  Somewhere for generated sound to go. A sink is specified as 
+  TYPE[:TARGET] -- for example "alsa:hw:0", "wav:out.wav", "raw", or
+  "null". What the target means depends on the type, and each type
+  has a default. Everything about the output -- format, rate, number 
+  of channels -- is decided when the sink is opened, and then fixed.
+
+  Each type of sink is a table of functions (SinkOps), in its own
+  file. This file just picks the right one, and keeps the counters.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include "defs.h" 
+#include "log.h" 
+#include "sink.h" 
+
+struct _Sink
+  {
+  const SinkOps *ops;
+  void *data;
+  SinkStats stats;
+  }; 
+
+// The sinks we know about. The first is the default
+static const SinkOps *sinks[] = 
+  {
+  &sink_alsa_ops, &sink_wav_ops, &sink_raw_ops, &sink_null_ops
+  };
+
+
+/*==========================================================================
+  sink_open
+  Open a sink, given as TYPE[:TARGET], with the settings in config, 
+    and fill in config with what it actually provides. Returns NULL
+    if the sink can't be opened, having logged the reason
+==========================================================================*/
+Sink *sink_open (const char *spec, SinkConfig *config)
+  {
+  LOG_IN
+  Sink *self = NULL;
+  const char *colon = strchr (spec, ':');
+  int len = colon ? colon - spec : strlen (spec);
+  const char *target = colon ? colon + 1 : NULL;
+
+  const SinkOps *ops = NULL;
+  int n = sizeof (sinks) / sizeof (sinks[0]);
+  for (int i = 0; i < n && !ops; i++)
+    {
+    if (strlen (sinks[i]->name) == len 
+        && strncmp (sinks[i]->name, spec, len) == 0)
+      ops = sinks[i];
+    }
+
+  if (ops)
+    {
+    self = malloc (sizeof (Sink));
+    memset (self, 0, sizeof (Sink));
+    self->ops = ops;
+    self->data = ops->open (target, config, &self->stats);
+    if (self->data)
+      log_debug ("Opened %s sink", ops->name);
+    else
+      {
+      free (self);
+      self = NULL;
+      }
+    }
+  else
+    log_error ("Unknown output type: %.*s", len, spec);
+  LOG_OUT
+  return self;
+  }
+
+
+/*==========================================================================
+  sink_parse_format
+  Parse the sample format for a sink that can take any format. NULL or
+    "auto" means signed 16-bit little-endian. Returns FALSE, having 
+    logged the reason, if the format isn't known
+==========================================================================*/
+BOOL sink_parse_format (const char *format, SampleFormat *f)
+  {
+  if (!format || strcasecmp (format, "auto") == 0)
+    {
+    *f = sample_format_s16_le;
+    return TRUE;
+    }
+  if (sampleformat_parse (format, f)) return TRUE;
+  log_error ("Unsupported sample format: %s", format);
+  return FALSE;
+  }
+
+
+/*==========================================================================
+  sink_set_defaults
+  Fill in the rate, channels, and period size for a sink that doesn't 
+    play in real time, and so has no preferences of its own. The period
+    size is only the most frames that are generated at once, so the
+    period time, which is meant for a device, doesn't apply
+==========================================================================*/
+void sink_set_defaults (SinkConfig *config)
+  {
+  if (config->rate == 0) config->rate = SINK_DEFAULT_RATE;
+  if (config->channels == 0) config->channels = 1;
+  config->period_frames = (int64_t)config->rate * SINK_OFFLINE_PERIOD_TIME 
+    / 1000000;
+  if (config->period_frames <= 0) config->period_frames = 1;
+  }
+
+
+/*==========================================================================
+  sink_open_file
+  Open a file for a sink to write, with a large buffer. A target of 
+    NULL or "-" means standard output, and sets *is_stdout. Returns
+    NULL, having logged the reason, if the file can't be opened
+==========================================================================*/
+FILE *sink_open_file (const char *target, BOOL *is_stdout)
+  {
+  FILE *f;
+  *is_stdout = !target || !target[0] || strcmp (target, "-") == 0;
+  if (*is_stdout)
+    f = stdout;
+  else
+    f = fopen (target, "wb");
+  if (!f)
+    {
+    log_error ("Can't open %s for writing: %s", target, strerror (errno));
+    return NULL;
+    }
+  setvbuf (f, NULL, _IOFBF, SINK_FILE_BUFFER_BYTES);
+  return f;
+  }
+
+
+/*==========================================================================
+  sink_close
+==========================================================================*/
+void sink_close (Sink *self)
+  {
+  LOG_IN
+  if (self)
+    {
+    if (self->ops->close) self->ops->close (self->data);
+    free (self);
+    }
+  LOG_OUT
+  }
+
+
+/*==========================================================================
+  sink_write
+  Write count frames, waiting for space if the sink plays in real 
+    time. Returns zero, or a negative error code if the sink has failed
+==========================================================================*/
+int sink_write (Sink *self, const BYTE *frames, int count)
+  {
+  int n = self->ops->write (self->data, frames, count);
+  if (n < 0) return n;
+  self->stats.frames_written += n;
+  return 0;
+  }
+
+
+/*==========================================================================
+  sink_start
+  Play anything that has been held back, because nothing more will be 
+    written for a while
+==========================================================================*/
+void sink_start (Sink *self)
+  {
+  if (self->ops->start) self->ops->start (self->data);
+  }
+
+
+/*==========================================================================
+  sink_drain
+  Wait until everything that has been written has been played
+==========================================================================*/
+void sink_drain (Sink *self)
+  {
+  LOG_IN
+  if (self->ops->drain) self->ops->drain (self->data);
+  LOG_OUT
+  }
+
+
+/*==========================================================================
+  sink_get_name
+==========================================================================*/
+const char *sink_get_name (const Sink *self)
+  {
+  return self->ops->name;
+  }
+
+
+/*==========================================================================
+  sink_get_stats
+==========================================================================*/
+void sink_get_stats (const Sink *self, SinkStats *stats)
+  {
+  *stats = self->stats;
+  }
+
+
+/*==========================================================================
+  sink_print_stats
+==========================================================================*/
+void sink_print_stats (const Sink *self, FILE *f)
+  {
+  const SinkStats *stats = &self->stats;
+  fprintf (f, "Frames written:    %lld\n", (long long)stats->frames_written);
+  fprintf (f, "Frames dropped:    %lld\n", (long long)stats->frames_dropped);
+  fprintf (f, "Underruns:         %d\n", stats->underruns);
+  fprintf (f, "Suspends:          %d\n", stats->suspends);
+  fprintf (f, "Recoveries:        %d\n", stats->recoveries);
+  fprintf (f, "Failures:          %d\n", stats->failures);
+  fprintf (f, "Idle underruns:    %d\n", stats->idle_underruns);
+  }
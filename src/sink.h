@@ -0,0 +1,103 @@
+/*============================================================================
+
+  tonegen 
+  sink.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include "defs.h"
+#include "sampleformat.h"
+
+// Sample rate in Hz used if none is requested and the sink has no
+//   preference of its own
+#define SINK_DEFAULT_RATE 48000
+
+// Sinks that don't play in real time generate this much sound at 
+//   once, in usec, whatever the period time. Bigger blocks mean fewer
+//   handovers between threads, and fewer writes
+#define SINK_OFFLINE_PERIOD_TIME 100000
+
+// Size of the stdio buffer for sinks that write to files
+#define SINK_FILE_BUFFER_BYTES (1024 * 1024)
+
+struct _Sink;
+typedef struct _Sink Sink;
+
+// What is wanted from a sink, and what it actually provides. Before
+//   opening, a format of NULL, or a rate or channel count of zero, 
+//   means the sink's choice; the times are in usec, and only matter
+//   to sinks that play in real time. Opening fills in the rest, and
+//   replaces the rate and channels with the actual values
+typedef struct _SinkConfig
+  {
+  const char *format;
+  unsigned int rate;
+  unsigned int channels;
+  int buffer_time;
+  int period_time;
+  int start_time;
+  SampleFormat sample_format;
+  // Most frames that should be written at once
+  int period_frames;
+  } SinkConfig;
+
+// Counters of what happened during output
+typedef struct _SinkStats
+  {
+  int64_t frames_written;
+  // Frames that were lost because of an underrun or suspend
+  int64_t frames_dropped;
+  int underruns;
+  int suspends;
+  int recoveries;
+  // Underruns or suspends that could not be recovered from
+  int failures;
+  // Underruns while there was nothing to play, which are harmless
+  int idle_underruns;
+  } SinkStats;
+
+// One kind of sink. open returns the sink's own data, which is passed
+//   to the other functions, or NULL if it fails, having logged the
+//   reason. write takes count whole frames, waiting if necessary, and
+//   returns the number actually delivered, or a negative error code
+//   if the sink has failed. start says that nothing more will be 
+//   written for a while, so anything held back should be played now.
+//   drain waits until everything written has been played. Any of 
+//   start, drain and close may be NULL
+typedef struct _SinkOps
+  {
+  const char *name;
+  void *(*open) (const char *target, SinkConfig *config, SinkStats *stats);
+  int   (*write) (void *data, const BYTE *frames, int count);
+  void  (*start) (void *data);
+  void  (*drain) (void *data);
+  void  (*close) (void *data);
+  } SinkOps;
+
+extern const SinkOps sink_alsa_ops;
+extern const SinkOps sink_wav_ops;
+extern const SinkOps sink_raw_ops;
+extern const SinkOps sink_null_ops;
+
+BEGIN_DECLS
+
+Sink       *sink_open (const char *spec, SinkConfig *config);
+void        sink_close (Sink *self);
+int         sink_write (Sink *self, const BYTE *frames, int count);
+void        sink_start (Sink *self);
+void        sink_drain (Sink *self);
+const char *sink_get_name (const Sink *self);
+void        sink_get_stats (const Sink *self, SinkStats *stats);
+void        sink_print_stats (const Sink *self, FILE *f);
+
+// For use by sink implementations
+BOOL        sink_parse_format (const char *format, SampleFormat *f);
+void        sink_set_defaults (SinkConfig *config);
+FILE       *sink_open_file (const char *target, BOOL *is_stdout);
+
+END_DECLS
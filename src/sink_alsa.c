@@ -0,0 +1,568 @@
+/*==========================================================================
+
+  tonegen
+  sink_alsa.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  A sink that plays sound on an ALSA PCM device. The target is the
+  device name -- "default" if none is given.
+
+  The device is used at a rate, channel count, and sample format that
+  it supports natively, where possible, so that ALSA's plug plugin
+  doesn't have to convert. The device is opened non-blocking, and the write function waits for space with
+  snd_pcm_wait(). Underruns and suspends are recovered from, and
+  counted, rather than stopping playback.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <poll.h>
+#include <alsa/asoundlib.h>
+#include "defs.h"
+#include "log.h"
+#include "sampleformat.h"
+#include "sink.h"
+
+// Most attempts to recover from underruns or suspends, with nothing
+//   successfully written in between, before giving up
+#define MAX_RECOVERIES 5
+
+// ALSA equivalents of the SampleFormat values
+static const snd_pcm_format_t alsa_formats[SAMPLE_FORMAT_COUNT] =
+  {SND_PCM_FORMAT_S16_LE, SND_PCM_FORMAT_S16_BE, SND_PCM_FORMAT_S24_3LE,
+   SND_PCM_FORMAT_S32_LE, SND_PCM_FORMAT_FLOAT_LE};
+
+// Formats to try, in order, if no specific format is requested.
+//   Everybody should support signed 16-bit but, if the device doesn't,
+//   we can use whatever it does support, rather than needing a plugin
+//   to convert
+static const SampleFormat preferred_formats[] =
+  {sample_format_s16_le, sample_format_s32_le, sample_format_s24_3le,
+   sample_format_float_le, sample_format_s16_be};
+
+typedef struct _SinkAlsa
+  {
+  snd_pcm_t *handle;
+  SinkStats *stats;
+  int frame_bytes;
+  int period_frames;
+  snd_pcm_sframes_t buffer_size;
+  int failed_recoveries;
+  // Set by start, when there's nothing more to play for the time
+  //   being, so that the underrun that follows isn't treated as a fault
+  BOOL idle;
+  } SinkAlsa;
+
+
+/*==========================================================================
+  sink_alsa_set_format
+  Set the sample format. If format is NULL or "auto", use the first of
+    the preferred formats that the device supports
+==========================================================================*/
+static int sink_alsa_set_format (snd_pcm_t *handle,
+                snd_pcm_hw_params_t *params, const char *format,
+                SampleFormat *sample_format)
+  {
+  int err = -EINVAL;
+  SampleFormat f;
+  if (format && strcasecmp (format, "auto") != 0)
+    {
+    if (sampleformat_parse (format, &f))
+      err = snd_pcm_hw_params_set_format (handle, params, alsa_formats[f]);
+    else
+      log_error ("Unsupported sample format: %s", format);
+    }
+  else
+    {
+    int n = sizeof (preferred_formats) / sizeof (SampleFormat);
+    for (int i = 0; i < n && err < 0; i++)
+      {
+      f = preferred_formats[i];
+      if (snd_pcm_hw_params_test_format (handle, params,
+           alsa_formats[f]) == 0)
+        err = snd_pcm_hw_params_set_format (handle, params,
+          alsa_formats[f]);
+      }
+    }
+  if (err == 0)
+    {
+    *sample_format = f;
+    log_debug ("Sample format is %s", sampleformat_get_name (f));
+    }
+  return err;
+  }
+
+/*==========================================================================
+  sink_alsa_set_channels
+  Use the number of channels requested, if the device supports it.
+    Otherwise, use mono if the device supports it or, if not, the
+    fewest channels the device has. Many hardware devices are
+    stereo-only, and would otherwise need the plug plugin to convert
+==========================================================================*/
+static int sink_alsa_set_channels (snd_pcm_t *handle,
+                snd_pcm_hw_params_t *params, unsigned int *channels)
+  {
+  unsigned int n = *channels > 0 ? *channels : 1;
+  int err = snd_pcm_hw_params_test_channels (handle, params, n);
+  if (err < 0 && n > 1)
+    {
+    log_warning ("%u channels not available", n);
+    n = 1;
+    err = snd_pcm_hw_params_test_channels (handle, params, n);
+    }
+  if (err < 0)
+    err = snd_pcm_hw_params_get_channels_min (params, &n);
+  if (err == 0)
+    err = snd_pcm_hw_params_set_channels (handle, params, n);
+  if (err == 0)
+    *channels = n;
+  return err;
+  }
+
+/*==========================================================================
+  sink_alsa_set_rate
+  Set the sample rate. ALSA's resampling is turned off, so that only
+    rates that the device supports natively are accepted. If a rate was
+    requested, and the device can't manage it, we get the nearest it
+    can. If not, SINK_DEFAULT_RATE is used if possible, and otherwise the
+    nearest to it. The rate may not be final until the parameters
+    have been installed
+==========================================================================*/
+static int sink_alsa_set_rate (snd_pcm_t *handle,
+                snd_pcm_hw_params_t *params, unsigned int *rate)
+  {
+  int err = snd_pcm_hw_params_set_rate_resample (handle, params, 0);
+  if (err < 0)
+    log_debug ("Can't disable resampling: %s", snd_strerror(err));
+  if (*rate == 0) *rate = SINK_DEFAULT_RATE;
+  return snd_pcm_hw_params_set_rate_near (handle, params, rate, 0);
+  }
+
+/*==========================================================================
+  sink_alsa_set_hwparams
+  Set up the ALSA hardware parameters, and fill in config with what the
+    device actually provides
+==========================================================================*/
+static int sink_alsa_set_hwparams (SinkAlsa *self,
+                snd_pcm_hw_params_t *params, SinkConfig *config)
+  {
+  snd_pcm_t *handle = self->handle;
+  unsigned int requested_rate = config->rate;
+  unsigned int rrate = config->rate;
+  snd_pcm_uframes_t size;
+  int err, dir = 0;
+  err = snd_pcm_hw_params_any(handle, params);
+  if (err < 0)
+    {
+    log_error ("No configurations available: %s",
+       snd_strerror(err));
+    return err;
+    }
+  err = snd_pcm_hw_params_set_access (handle, params,
+    SND_PCM_ACCESS_RW_INTERLEAVED);
+  if (err < 0)
+    {
+    log_error ("Access type not available: %s", snd_strerror(err));
+    return err;
+    }
+  err = sink_alsa_set_format (handle, params, config->format,
+    &config->sample_format);
+  if (err < 0)
+    {
+    log_error ("Sample format not available: %s",
+      snd_strerror(err));
+    return err;
+    }
+  err = sink_alsa_set_channels (handle, params, &config->channels);
+  if (err < 0)
+    {
+    log_error ("No usable channel count: %s",
+      snd_strerror(err));
+    return err;
+    }
+  err = sink_alsa_set_rate (handle, params, &rrate);
+  if (err < 0)
+    {
+    log_error ("Can't set sample rate: %s", snd_strerror(err));
+    return err;
+    }
+  config->rate = rrate;
+  unsigned int btime = config->buffer_time;
+  err = snd_pcm_hw_params_set_buffer_time_near (handle, params,
+    &btime, &dir);
+  if (err < 0)
+    {
+    log_error ("Unable to set buffer time %i: %s\n",
+      config->buffer_time, snd_strerror(err));
+    return err;
+    }
+  err = snd_pcm_hw_params_get_buffer_size(params, &size);
+  if (err < 0)
+    {
+    log_error ("Unable to get buffer size: %s\n",
+      snd_strerror(err));
+    return err;
+    }
+  self->buffer_size = size;
+
+  unsigned int ptime = config->period_time;
+  err = snd_pcm_hw_params_set_period_time_near (handle, params,
+      &ptime, &dir);
+  if (err < 0)
+    {
+    log_error ("Unable to set period time %i: %s\n",
+      config->period_time, snd_strerror(err));
+    return err;
+    }
+  err = snd_pcm_hw_params_get_period_size (params, &size, &dir);
+  if (err < 0)
+    {
+    log_error ("Unable to get period size: %s\n",
+      snd_strerror(err));
+    return err;
+    }
+  self->period_frames = size;
+  err = snd_pcm_hw_params (handle, params);
+  if (err < 0)
+    {
+    log_error ("Unable to set hwparams: %s\n", snd_strerror(err));
+    return err;
+    }
+  // This is the rate that the generators will use, so it must be the
+  //   one finally granted
+  if (snd_pcm_hw_params_get_rate (params, &rrate, &dir) == 0 && rrate > 0)
+    config->rate = rrate;
+  if (requested_rate > 0 && config->rate != requested_rate)
+    log_warning ("Rate %uHz not available -- using %uHz",
+      requested_rate, config->rate);
+  log_debug ("Rate is %uHz, %u channel(s)", config->rate, config->channels);
+  return 0;
+  }
+
+/*==========================================================================
+  sink_alsa_set_swparams
+  Set up buffering based on the buffer size and period size returned
+    by the hardware
+==========================================================================*/
+static int sink_alsa_set_swparams (SinkAlsa *self,
+        snd_pcm_sw_params_t *swparams, const SinkConfig *config)
+  {
+  snd_pcm_t *handle = self->handle;
+  snd_pcm_sframes_t buffer_size = self->buffer_size;
+  snd_pcm_sframes_t period_size = self->period_frames;
+  long rate = config->rate;
+  int err;
+  err = snd_pcm_sw_params_current(handle, swparams);
+  if (err < 0)
+    {
+    log_error ("Unable to determine current swparams: %s\n",
+      snd_strerror(err));
+    return err;
+    }
+  // The start threshold can't usefully be more than the largest
+  //   number of whole periods that fit in the buffer
+  snd_pcm_sframes_t max_threshold = (buffer_size / period_size) * period_size;
+  snd_pcm_sframes_t start_threshold = 
+    (int64_t)config->start_time * rate / 1000000;
+  if (start_threshold <= 0 || start_threshold > max_threshold)
+    start_threshold = max_threshold;
+  log_debug ("Buffer %ld frames (%ld usec), period %ld frames (%ld usec), "
+    "start threshold %ld frames (%ld usec)",
+    buffer_size, buffer_size * 1000000L / rate,
+    period_size, period_size * 1000000L / rate,
+    start_threshold, start_threshold * 1000000L / rate);
+  err = snd_pcm_sw_params_set_start_threshold (handle, swparams,
+    start_threshold);
+  if (err < 0)
+    {
+    log_error ("Unable to set start threshold: %s",
+      snd_strerror(err));
+    return err;
+    }
+  err = snd_pcm_sw_params_set_avail_min (handle, swparams, period_size);
+  if (err < 0)
+    {
+    log_error ("Unable to set avail min for playback: %s",
+      snd_strerror(err));
+    return err;
+    }
+  err = snd_pcm_sw_params(handle, swparams);
+  if (err < 0)
+    {
+    log_error ("Unable to set sw params for playback: %s",
+      snd_strerror(err));
+    return err;
+    }
+  return 0;
+  }
+
+/*==========================================================================
+  sink_alsa_open
+==========================================================================*/
+static void *sink_alsa_open (const char *target, SinkConfig *config,
+    SinkStats *stats)
+  {
+  LOG_IN
+  const char *device = target && target[0] ? target : "default";
+  SinkAlsa *self = malloc (sizeof (SinkAlsa));
+  memset (self, 0, sizeof (SinkAlsa));
+  self->stats = stats;
+  snd_pcm_hw_params_t *hwparams;
+  snd_pcm_sw_params_t *swparams;
+  snd_pcm_hw_params_alloca (&hwparams);
+  snd_pcm_sw_params_alloca (&swparams);
+  int err;
+  if ((err = snd_pcm_open (&self->handle, device, SND_PCM_STREAM_PLAYBACK,
+      SND_PCM_NONBLOCK)) < 0)
+    {
+    log_error ("Can't open playback device %s: %s", device,
+      snd_strerror(err));
+    free (self);
+    LOG_OUT
+    return NULL;
+    }
+
+  if ((err = sink_alsa_set_hwparams (self, hwparams, config)) < 0)
+    log_error ("Can't set hwparams: %s", snd_strerror(err));
+  else if ((err = sink_alsa_set_swparams (self, swparams, config)) < 0)
+    log_error ("Can't set swparams: %s", snd_strerror(err));
+  if (err < 0)
+    {
+    snd_pcm_close (self->handle);
+    free (self);
+    LOG_OUT
+    return NULL;
+    }
+
+  self->frame_bytes = sampleformat_get_bytes (config->sample_format)
+    * config->channels;
+  config->period_frames = self->period_frames;
+  LOG_OUT
+  return self;
+  }
+
+/*=========================================================================
+  sink_alsa_transfer
+  Write count frames to the device. The frames come straight from the
+    ring buffer that the audio thread is sending, so there is no copy 
+    here beyond the one snd_pcm_writei() makes. mmap access would 
+    only save that copy if sound were rendered into the device's own 
+    buffer, which would put rendering back on the audio thread.
+    Returns zero, or a negative error code. Either way, *written is
+    set to the number of frames that the device accepted
+==========================================================================*/
+static int sink_alsa_transfer (SinkAlsa *self, const BYTE *samples,
+    int count, int *written)
+  {
+  snd_pcm_t *handle = self->handle;
+  int err;
+  *written = 0;
+  while (count > 0)
+    {
+    err = snd_pcm_writei (handle, samples, count);
+    if (err == -EAGAIN)
+      {
+      // The PCM is non-blocking, so the device may take only some of
+      //   the frames; wait for space for the rest
+      err = snd_pcm_wait (handle, -1);
+      if (err < 0) return err;
+      continue;
+      }
+    if (err < 0) return err;
+    samples += err * self->frame_bytes;
+    count -= err;
+    *written += err;
+    }
+  return 0;
+  }
+
+/*=========================================================================
+  sink_alsa_recover
+  Try to recover from an underrun (-EPIPE) or a suspend (-ESTRPIPE),
+    and count it. An underrun while there was nothing to play isn't a
+    fault, and is only counted as idle. Returns zero if playback can
+    continue, or the original error if not. We give up after
+    MAX_RECOVERIES attempts without any frames being written in between.
+    This is usually called from a real-time thread, so it doesn't log
+    unless it fails
+==========================================================================*/
+static int sink_alsa_recover (SinkAlsa *self, int err)
+  {
+  SinkStats *stats = self->stats;
+  if (err == -EPIPE && self->idle)
+    stats->idle_underruns++;
+  else if (err == -EPIPE)
+    stats->underruns++;
+  else if (err == -ESTRPIPE)
+    stats->suspends++;
+  else
+    return err;
+
+  if (++self->failed_recoveries > MAX_RECOVERIES)
+    {
+    log_error ("Giving up on playback after %d attempts to recover: %s",
+      MAX_RECOVERIES, snd_strerror (err));
+    stats->failures++;
+    return err;
+    }
+  int ret = snd_pcm_recover (self->handle, err, 1);
+  if (ret < 0)
+    {
+    log_error ("Can't recover playback: %s", snd_strerror (ret));
+    stats->failures++;
+    return err;
+    }
+  if (!self->idle)
+    stats->recoveries++;
+  return 0;
+  }
+
+/*=========================================================================
+  sink_alsa_write
+  Send count frames to the device, a period at a time, waiting for
+    space as necessary. Underruns and suspends are recovered from, but
+    the frames that were being written when one happened are lost --
+    the sound carries on from where it would have been
+==========================================================================*/
+static int sink_alsa_write (void *data, const BYTE *frames, int count)
+  {
+  SinkAlsa *self = data;
+  snd_pcm_t *handle = self->handle;
+  int err, delivered = 0;
+  while (count > 0)
+    {
+    int n = count < self->period_frames ? count : self->period_frames;
+    snd_pcm_sframes_t avail = snd_pcm_avail_update (handle);
+    if (avail < 0)
+      {
+      if ((err = sink_alsa_recover (self, avail)) < 0) return err;
+      continue;
+      }
+    if (avail < n)
+      {
+      // If the buffer is as full as it will get, but playback hasn't
+      //   started, nothing will ever make space in it
+      if (snd_pcm_state (handle) == SND_PCM_STATE_PREPARED)
+        snd_pcm_start (handle);
+      err = snd_pcm_wait (handle, -1);
+      if (err < 0 && (err = sink_alsa_recover (self, err)) < 0)
+        return err;
+      continue;
+      }
+    int written;
+    err = sink_alsa_transfer (self, frames, n, &written);
+    frames += n * self->frame_bytes;
+    count -= n;
+    delivered += written;
+    if (err < 0)
+      {
+      self->stats->frames_dropped += n - written;
+      if ((err = sink_alsa_recover (self, err)) < 0) return err;
+      }
+    else
+      {
+      self->failed_recoveries = 0;
+      self->idle = FALSE;
+      }
+    }
+  return delivered;
+  }
+
+/*=========================================================================
+  sink_alsa_start
+  Start playback, if it hasn't started, even though the start threshold
+    hasn't been reached. The device will probably run out of sound
+    before there is more, but that doesn't count as an underrun
+==========================================================================*/
+static void sink_alsa_start (void *data)
+  {
+  SinkAlsa *self = data;
+  self->idle = TRUE;
+  if (snd_pcm_state (self->handle) == SND_PCM_STATE_PREPARED
+       && snd_pcm_avail_update (self->handle) < self->buffer_size)
+    snd_pcm_start (self->handle);
+  }
+
+/*==========================================================================
+  sink_alsa_drain
+  Wait until everything that has been written has actually been
+    played. The device reports how long that will take, so we sleep
+    for that long and then check again, rather than polling at a fixed
+    rate. The sleep is a poll() on the device's descriptors, so that
+    an error -- the device being unplugged, for example -- ends it
+    early. In case the device stops making progress, we don't wait
+    more than a second longer than it first said
+==========================================================================*/
+static void sink_alsa_drain (void *data)
+  {
+  SinkAlsa *self = data;
+  snd_pcm_t *handle = self->handle;
+  // If less than the start threshold was written, playback hasn't
+  //   started yet
+  if (snd_pcm_state (handle) == SND_PCM_STATE_PREPARED)
+    snd_pcm_start (handle);
+
+  int nfds = snd_pcm_poll_descriptors_count (handle);
+  if (nfds < 0) nfds = 0;
+  struct pollfd *pfds = malloc ((nfds + 1) * sizeof (struct pollfd));
+  nfds = snd_pcm_poll_descriptors (handle, pfds, nfds);
+  if (nfds < 0) nfds = 0;
+  // We only want to know about errors, which poll() always reports.
+  //   Space in the buffer is of no interest now
+  for (int i = 0; i < nfds; i++)
+    pfds[i].events = 0;
+
+  unsigned int rate = 0;
+  snd_pcm_hw_params_t *params;
+  snd_pcm_hw_params_alloca (&params);
+  if (snd_pcm_hw_params_current (handle, params) == 0)
+    snd_pcm_hw_params_get_rate (params, &rate, NULL);
+  if (rate == 0) rate = SINK_DEFAULT_RATE;
+
+  snd_pcm_sframes_t delay;
+  int budget = -1; // msec
+  while (snd_pcm_state (handle) == SND_PCM_STATE_RUNNING
+       && snd_pcm_delay (handle, &delay) == 0 && delay > 0)
+    {
+    int msec = (delay * 1000 + rate - 1) / rate;
+    if (budget < 0) budget = msec + 1000;
+    if (budget <= 0)
+      {
+      log_warning ("Playback did not finish");
+      break;
+      }
+    budget -= msec;
+    if (poll (pfds, nfds, msec) > 0)
+      {
+      log_debug ("Error from device while waiting for playback to end");
+      break;
+      }
+    }
+  free (pfds);
+
+  // Everything has been played, so this doesn't block; but it stops
+  //   the device cleanly
+  snd_pcm_nonblock (handle, 0);
+  snd_pcm_drain (handle);
+  }
+
+/*==========================================================================
+  sink_alsa_close
+==========================================================================*/
+static void sink_alsa_close (void *data)
+  {
+  SinkAlsa *self = data;
+  snd_pcm_close (self->handle);
+  free (self);
+  }
+
+const SinkOps sink_alsa_ops =
+  {
+  "alsa", sink_alsa_open, sink_alsa_write, sink_alsa_start,
+  sink_alsa_drain, sink_alsa_close
+  };
@@ -0,0 +1,53 @@
+/*==========================================================================
+
+  tonegen
+  sink_null.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  A sink that discards everything written to it. It takes any format,
+  and sound is generated as fast as possible, so it's useful for
+  timing. The target, if any, is ignored.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "defs.h"
+#include "log.h"
+#include "sampleformat.h"
+#include "sink.h"
+
+// Something to return from open, which mustn't be NULL
+static int sink_null_data;
+
+
+/*==========================================================================
+  sink_null_open
+==========================================================================*/
+static void *sink_null_open (const char *target, SinkConfig *config,
+    SinkStats *stats)
+  {
+  (void)target; (void)stats;
+  SampleFormat f;
+  if (!sink_parse_format (config->format, &f)) return NULL;
+  sink_set_defaults (config);
+  config->sample_format = f;
+  return &sink_null_data;
+  }
+
+
+/*==========================================================================
+  sink_null_write
+==========================================================================*/
+static int sink_null_write (void *data, const BYTE *frames, int count)
+  {
+  (void)data; (void)frames;
+  return count;
+  }
+
+const SinkOps sink_null_ops =
+  {
+  "null", sink_null_open, sink_null_write, NULL, NULL, NULL
+  };
+
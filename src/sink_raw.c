@@ -0,0 +1,107 @@
+/*==========================================================================
+
+  tonegen
+  sink_raw.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  A sink that writes bare, interleaved samples, with no header. The
+  target is the file name; without one, or if it's "-", samples go
+  to standard output. Any sample format can be used.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "defs.h"
+#include "log.h"
+#include "sampleformat.h"
+#include "sink.h"
+
+typedef struct _SinkRaw
+  {
+  FILE *f;
+  BOOL is_stdout;
+  int frame_bytes;
+  } SinkRaw;
+
+
+/*==========================================================================
+  sink_raw_open
+==========================================================================*/
+static void *sink_raw_open (const char *target, SinkConfig *config,
+    SinkStats *stats)
+  {
+  LOG_IN
+  (void)stats;
+  SampleFormat f;
+  if (!sink_parse_format (config->format, &f))
+    {
+    LOG_OUT
+    return NULL;
+    }
+
+  SinkRaw *self = malloc (sizeof (SinkRaw));
+  memset (self, 0, sizeof (SinkRaw));
+  self->f = sink_open_file (target, &self->is_stdout);
+  if (!self->f)
+    {
+    free (self);
+    LOG_OUT
+    return NULL;
+    }
+
+  sink_set_defaults (config);
+  config->sample_format = f;
+  self->frame_bytes = sampleformat_get_bytes (f) * config->channels;
+  LOG_OUT
+  return self;
+  }
+
+
+/*==========================================================================
+  sink_raw_write
+==========================================================================*/
+static int sink_raw_write (void *data, const BYTE *frames, int count)
+  {
+  SinkRaw *self = data;
+  errno = 0;
+  size_t n = fwrite (frames, self->frame_bytes, count, self->f);
+  if (n < (size_t)count) return errno ? -errno : -EIO;
+  return n;
+  }
+
+
+/*==========================================================================
+  sink_raw_start
+  Nothing more is coming for a while, so whatever reads the output
+    should have what there is so far
+==========================================================================*/
+static void sink_raw_start (void *data)
+  {
+  SinkRaw *self = data;
+  fflush (self->f);
+  }
+
+
+/*==========================================================================
+  sink_raw_close
+==========================================================================*/
+static void sink_raw_close (void *data)
+  {
+  SinkRaw *self = data;
+  // With a large buffer, this is where a full disk shows up
+  int err = self->is_stdout ? fflush (self->f) : fclose (self->f);
+  if (err != 0)
+    log_error ("Can't write output: %s", strerror (errno));
+  free (self);
+  }
+
+const SinkOps sink_raw_ops =
+  {
+  "raw", sink_raw_open, sink_raw_write, sink_raw_start, NULL,
+  sink_raw_close
+  };
+
@@ -0,0 +1,235 @@
+/*==========================================================================
+
+  tonegen
+  sink_wav.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  A sink that writes a WAV file. The target is the file name, or "-"
+  for standard output. If the file can be rewound, space is left for 
+  the header, which is written once, with the right lengths, when the
+  sink is closed. If it can't -- a pipe, for example -- the header is
+  written first, with the lengths set to the largest possible, which
+  most programs that read WAV from a pipe understand as "until the 
+  end".
+
+  Samples of more than 16 bits, or more than two channels, are 
+  described with WAVE_FORMAT_EXTENSIBLE, as the WAV specification asks;
+  otherwise the plain format is used, which every reader understands.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "defs.h"
+#include "log.h"
+#include "sampleformat.h"
+#include "sink.h"
+
+// Size of the RIFF, fmt, and data headers together, for the plain and
+//   the extensible formats
+#define WAV_HEADER_BYTES 44
+#define WAV_EXT_HEADER_BYTES 68
+
+// Most bytes that a header can have
+#define WAV_MAX_HEADER_BYTES WAV_EXT_HEADER_BYTES
+
+// WAV format codes
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_FLOAT 3
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+// The rest of the GUID of an extensible format's sub-format, after the
+//   format code
+static const BYTE wav_guid_tail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+  0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+
+typedef struct _SinkWav
+  {
+  FILE *f;
+  BOOL is_stdout;
+  // TRUE if the header is to be written at the end
+  BOOL seekable;
+  SampleFormat sample_format;
+  unsigned int rate;
+  unsigned int channels;
+  int frame_bytes;
+  // TRUE if the header uses WAVE_FORMAT_EXTENSIBLE
+  BOOL extensible;
+  int header_bytes;
+  int64_t data_bytes;
+  } SinkWav;
+
+
+/*==========================================================================
+  sink_wav_put
+  Store n bytes of value in little-endian order
+==========================================================================*/
+static BYTE *sink_wav_put (BYTE *p, uint32_t value, int n)
+  {
+  for (int i = 0; i < n; i++)
+    {
+    *p++ = value & 0xFF;
+    value >>= 8;
+    }
+  return p;
+  }
+
+
+/*==========================================================================
+  sink_wav_write_header
+  Write the header at the current position, with data_bytes of samples
+    to follow. A negative data_bytes means not known. A chunk of an odd
+    size is followed by a pad byte, which the RIFF length includes but 
+    the data length doesn't
+==========================================================================*/
+static BOOL sink_wav_write_header (const SinkWav *self, int64_t data_bytes)
+  {
+  BYTE header[WAV_MAX_HEADER_BYTES];
+  uint32_t data_len = 0xFFFFFFFF;
+  uint32_t riff_len = 0xFFFFFFFF;
+  int64_t padded = data_bytes + (data_bytes & 1);
+  if (data_bytes >= 0 && padded <= 0xFFFFFFFF - self->header_bytes)
+    {
+    data_len = data_bytes;
+    riff_len = padded + self->header_bytes - 8;
+    }
+  int bytes = sampleformat_get_bytes (self->sample_format);
+  int code = self->sample_format == sample_format_float_le
+    ? WAV_FORMAT_FLOAT : WAV_FORMAT_PCM;
+
+  BYTE *p = header;
+  memcpy (p, "RIFF", 4); p += 4;
+  p = sink_wav_put (p, riff_len, 4);
+  memcpy (p, "WAVEfmt ", 8); p += 8;
+  p = sink_wav_put (p, self->extensible ? 40 : 16, 4);
+  p = sink_wav_put (p, self->extensible ? WAV_FORMAT_EXTENSIBLE : code, 2);
+  p = sink_wav_put (p, self->channels, 2);
+  p = sink_wav_put (p, self->rate, 4);
+  p = sink_wav_put (p, self->rate * self->frame_bytes, 4);
+  p = sink_wav_put (p, self->frame_bytes, 2);
+  p = sink_wav_put (p, bytes * 8, 2);
+  if (self->extensible)
+    {
+    // Extension size, valid bits, and channel mask. Mono and stereo
+    //   have their usual speakers; the channels of anything else
+    //   aren't assigned to any speaker
+    p = sink_wav_put (p, 22, 2);
+    p = sink_wav_put (p, bytes * 8, 2);
+    p = sink_wav_put (p, self->channels == 1 ? 0x4 
+      : self->channels == 2 ? 0x3 : 0, 4);
+    p = sink_wav_put (p, code, 2);
+    memcpy (p, wav_guid_tail, sizeof (wav_guid_tail)); 
+    p += sizeof (wav_guid_tail);
+    }
+  memcpy (p, "data", 4); p += 4;
+  p = sink_wav_put (p, data_len, 4);
+  return fwrite (header, self->header_bytes, 1, self->f) == 1;
+  }
+
+
+/*==========================================================================
+  sink_wav_open
+==========================================================================*/
+static void *sink_wav_open (const char *target, SinkConfig *config,
+    SinkStats *stats)
+  {
+  LOG_IN
+  (void)stats;
+  if (!target || !target[0])
+    {
+    log_error ("A WAV sink needs a file name, or - for standard output");
+    LOG_OUT
+    return NULL;
+    }
+  SampleFormat f;
+  if (!sink_parse_format (config->format, &f))
+    {
+    LOG_OUT
+    return NULL;
+    }
+  // WAV files are always little-endian
+  if (f == sample_format_s16_be)
+    {
+    log_warning ("WAV files can't hold %s -- using %s",
+      sampleformat_get_name (f),
+      sampleformat_get_name (sample_format_s16_le));
+    f = sample_format_s16_le;
+    }
+
+  SinkWav *self = malloc (sizeof (SinkWav));
+  memset (self, 0, sizeof (SinkWav));
+  self->f = sink_open_file (target, &self->is_stdout);
+  if (!self->f)
+    {
+    free (self);
+    LOG_OUT
+    return NULL;
+    }
+
+  sink_set_defaults (config);
+  config->sample_format = f;
+  self->sample_format = f;
+  self->rate = config->rate;
+  self->channels = config->channels;
+  self->frame_bytes = sampleformat_get_bytes (f) * config->channels;
+  self->extensible = sampleformat_get_bytes (f) > 2 || config->channels > 2;
+  self->header_bytes = self->extensible 
+    ? WAV_EXT_HEADER_BYTES : WAV_HEADER_BYTES;
+  self->seekable = fseek (self->f, self->header_bytes, SEEK_SET) == 0;
+  if (!self->seekable && !sink_wav_write_header (self, -1))
+    {
+    log_error ("Can't write %s: %s", target, strerror (errno));
+    if (!self->is_stdout) fclose (self->f);
+    free (self);
+    LOG_OUT
+    return NULL;
+    }
+  LOG_OUT
+  return self;
+  }
+
+
+/*==========================================================================
+  sink_wav_write
+==========================================================================*/
+static int sink_wav_write (void *data, const BYTE *frames, int count)
+  {
+  SinkWav *self = data;
+  errno = 0;
+  size_t n = fwrite (frames, self->frame_bytes, count, self->f);
+  self->data_bytes += (int64_t)n * self->frame_bytes;
+  if (n < (size_t)count) return errno ? -errno : -EIO;
+  return n;
+  }
+
+
+/*==========================================================================
+  sink_wav_close
+  Write the pad byte that an odd-sized data chunk needs, and the 
+    header, if the file can be rewound
+==========================================================================*/
+static void sink_wav_close (void *data)
+  {
+  SinkWav *self = data;
+  if (self->seekable && (self->data_bytes & 1) && fputc (0, self->f) == EOF)
+    log_error ("Can't write output: %s", strerror (errno));
+  if (self->seekable && fseek (self->f, 0, SEEK_SET) == 0)
+    {
+    if (!sink_wav_write_header (self, self->data_bytes))
+      log_error ("Can't write WAV header: %s", strerror (errno));
+    }
+  // With a large buffer, this is where a full disk shows up
+  int err = self->is_stdout ? fflush (self->f) : fclose (self->f);
+  if (err != 0)
+    log_error ("Can't write output: %s", strerror (errno));
+  free (self);
+  }
+
+const SinkOps sink_wav_ops =
+  {
+  "wav", sink_wav_open, sink_wav_write, NULL, NULL, sink_wav_close
+  };
+
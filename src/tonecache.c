@@ -0,0 +1,156 @@
+/*==========================================================================
+
+  tonegen 
+  tonecache.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  A cache of steady tones, already rendered in the output format. A
+  tone of a whole number of Hz repeats exactly after a whole number
+  of samples -- at most one second's worth -- so a tone of any length 
+  can be played by rendering that much once, and then sending it to 
+  the device repeatedly. Entries are identified by frequency, waveform,
+  and gain, and the oldest entry is replaced when the cache is full.
+
+  The cache knows nothing about how its data was rendered, so it 
+  must be cleared whenever something changes the output for a given
+  frequency -- the sample format or the sine table, for example.
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h" 
+#include "log.h" 
+#include "tonecache.h" 
+
+typedef struct _ToneCacheEntry
+  {
+  int freq;
+  int waveform;
+  int gain;
+  // Rendered samples, or NULL if the entry is unused
+  BYTE *data;
+  int frames;
+  } ToneCacheEntry;
+
+struct _ToneCache
+  {
+  ToneCacheEntry entries[TONECACHE_ENTRIES];
+  // The entry to be replaced next
+  int next;
+  }; 
+
+
+/*==========================================================================
+  tonecache_create
+==========================================================================*/
+ToneCache *tonecache_create (void)
+  {
+  LOG_IN
+  ToneCache *self = malloc (sizeof (ToneCache));
+  memset (self, 0, sizeof (ToneCache));
+  LOG_OUT
+  return self;
+  }
+
+
+/*==========================================================================
+  tonecache_clear
+  Discard all the rendered tones
+==========================================================================*/
+void tonecache_clear (ToneCache *self)
+  {
+  LOG_IN
+  if (self)
+    {
+    for (int i = 0; i < TONECACHE_ENTRIES; i++)
+      free (self->entries[i].data);
+    memset (self, 0, sizeof (ToneCache));
+    }
+  LOG_OUT
+  }
+
+
+/*==========================================================================
+  tonecache_destroy
+==========================================================================*/
+void tonecache_destroy (ToneCache *self)
+  {
+  LOG_IN
+  if (self)
+    {
+    tonecache_clear (self);
+    free (self);
+    }
+  LOG_OUT
+  }
+
+
+/*==========================================================================
+  tonecache_find
+  Get the rendered samples for a tone, and set *frames to their number.
+    Returns NULL if the tone has not been rendered. The data remains
+    owned by the cache
+==========================================================================*/
+const BYTE *tonecache_find (const ToneCache *self, int freq, int waveform, 
+     int gain, int *frames)
+  {
+  for (int i = 0; i < TONECACHE_ENTRIES; i++)
+    {
+    const ToneCacheEntry *e = &self->entries[i];
+    if (e->data && e->freq == freq && e->waveform == waveform 
+         && e->gain == gain)
+      {
+      *frames = e->frames;
+      return e->data;
+      }
+    }
+  return NULL;
+  }
+
+
+/*==========================================================================
+  tonecache_add
+  Store rendered samples for a tone. The cache takes ownership of data,
+    which must have been allocated with malloc(). The data should be
+    a whole number of repeats of the tone, starting at zero phase
+==========================================================================*/
+void tonecache_add (ToneCache *self, int freq, int waveform, int gain, 
+     BYTE *data, int frames)
+  {
+  LOG_IN
+  ToneCacheEntry *e = &self->entries[self->next];
+  free (e->data);
+  e->freq = freq;
+  e->waveform = waveform;
+  e->gain = gain;
+  e->data = data;
+  e->frames = frames;
+  self->next = (self->next + 1) % TONECACHE_ENTRIES;
+  log_debug ("Cached tone %d Hz, waveform %d, gain %d, %d frames", 
+    freq, waveform, gain, frames);
+  LOG_OUT
+  }
+
+
+/*==========================================================================
+  tonecache_loop_frames
+  Get the smallest number of frames after which a tone of freq Hz
+    repeats exactly, at the given sample rate. freq cycles take
+    exactly rate frames, so this is rate divided by the largest
+    number that divides both
+==========================================================================*/
+int tonecache_loop_frames (int freq, int rate)
+  {
+  int a = freq, b = rate;
+  while (b != 0)
+    {
+    int t = a % b;
+    a = b;
+    b = t;
+    }
+  return rate / a;
+  }
+
@@ -0,0 +1,31 @@
+/*============================================================================
+
+  tonegen 
+  tonecache.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "defs.h"
+
+// Number of different tones that are kept rendered at once
+#define TONECACHE_ENTRIES 8
+
+struct _ToneCache;
+typedef struct _ToneCache ToneCache;
+
+BEGIN_DECLS
+
+ToneCache  *tonecache_create (void);
+void        tonecache_destroy (ToneCache *self);
+void        tonecache_clear (ToneCache *self);
+const BYTE *tonecache_find (const ToneCache *self, int freq, int waveform, 
+              int gain, int *frames);
+void        tonecache_add (ToneCache *self, int freq, int waveform, 
+              int gain, BYTE *data, int frames);
+int         tonecache_loop_frames (int freq, int rate);
+
+END_DECLS
@@ -5,7 +5,7 @@
   Copyright (c)2020 Kevin Boone
   Distributed under the terms of the GPL v3.0
 
-  Functions for playing tones using ALSA
+  Functions for generating tones, and passing them to a sink
 
 ==========================================================================*/
 
@@ -13,11 +13,19 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <getopt.h>
 #include <wchar.h>
 #include <time.h>
 #include <math.h>
-#include <alsa/asoundlib.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
 #include "program_context.h" 
 #include "feature.h" 
 #include "program.h" 
@@ -27,544 +35,890 @@
 #include "list.h" 
 #include "path.h" 
 #include "numberformat.h" 
+#include "wavetable.h" 
+#include "kernel.h" 
+#include "sampleformat.h" 
+#include "rng.h" 
+#include "ramp.h" 
+#include "tonecache.h" 
+#include "ringbuffer.h" 
+#include "sink.h" 
+#include "bench.h" 
 #include "tonegen.h" 
 
-// Sample rate in Hz
-#define RATE 48000
+// Buffering requested from the device, all in usec. The buffer time is
+//   the most audio that can be queued, and the period time is how much 
+//   is written at once. Playback starts when start_time's worth has 
+//   been queued, or when the buffer is full if start_time is zero
+typedef struct _LatencyProfile
+  {
+  const char *name;
+  int buffer_time;
+  int period_time;
+  int start_time;
+  } LatencyProfile;
 
-// Data format -- everybody should support signed 16-bit 
-#define FORMAT SND_PCM_FORMAT_S16
+// The first profile is the default. "low" starts playing as soon as 
+//   the first period has been written, and never queues more than
+//   40msec, so sounds follow events closely
+static const LatencyProfile latency_profiles[] = 
+  {
+  {"normal", 2000000, 10000, 0},
+  {"low", 40000, 10000, 10000},
+  };
 
-// Output buffer size in usec
-#define BUFFER_TIME 2000000
+static int buffer_time = 2000000;
+static int period_time = 10000;
+static int start_time = 0;
 
-// Length of a single buffer update in usec. To get smooth whistles, this
-//  needs to be < 20msec or so 
-#define PERIOD_TIME 10000
+// Largest sample value in a generated block. Blocks are always 16-bit,
+//   whatever the output format
+#define MAXVAL 32767
 
-/* ==========================================================================
-  tonegen_generate_sine
-  fill the buffer with sinewave, paying attention to the starting point
-  (phase), which will have been carried forward from the previous
-  period to avoid discontinuity
+// Every sound fades out over this many frames (10 msec) at the end,
+//   to avoid a click
+#define FADE_FRAMES (rate / 100)
+
+// A buzz restarts its phase every this many frames, and random tones
+//   and buzzes change pitch this often unless told otherwise
+#define CHANGE_FRAMES (rate / 100)
+
+// Size of the ring buffer between the thread that generates sound and
+//   the audio thread, in periods. This adds to the latency, so it 
+//   should be small; it only has to cover delays in generating sound,
+//   since the device has its own buffer
+#define RING_PERIODS 4
+
+// SCHED_FIFO priority of the audio thread, if real-time scheduling is
+//   used
+#define REALTIME_PRIORITY 50
+
+// The sample rate and channel count requested (zero meaning the 
+//   sink's choice), and the rate and number of channels that the 
+//   sink actually provides. All frequencies and durations are 
+//   converted to frames and phase increments using the actual rate
+static unsigned int requested_rate = 0;
+static unsigned int rate = SINK_DEFAULT_RATE;
+static unsigned int requested_channels = 0;
+static unsigned int channels = 1;
+
+// The gain of each channel, where RAMP_UNITY is full volume. Every 
+//   channel gets the same sound, at this gain. If a route has been 
+//   set, channels it doesn't mention are silent; otherwise all are
+//   at full volume
+static int channel_gains[TONEGEN_MAX_CHANNELS];
+static int route_channels = 0;
+
+// Sine table used by tonegen_generate_sine. If NULL, sin() is called
+//   for every sample instead
+static Wavetable *sine_table = NULL;
+
+// The output format, and the function that writes it. These are 
+//   set when the sink is opened
+static SampleFormat sample_format = sample_format_s16_le;
+static SampleWriter sample_writer = NULL;
+
+// Band-limiting applied to square waves and buzzes -- see 
+//   kernel_square_blep. Zero means none
+static int square_quality = 0;
+
+// Source of noise and random pitches. See tonegen_set_seed
+static Rng rng;
+
+// Shape of the fade at the end of each sound
+static RampShape fade_shape = ramp_linear;
+
+// Where the sound goes, once the audio thread has taken it from the
+//   ring buffer
+static Sink *sink = NULL;
+
+// Most frames that are transferred at once -- one period. Sounds are 
+//   generated into render_block, this size, before conversion to the
+//   output format. With more than one channel, the converted samples 
+//   go into channel_buffer, before being interleaved, and channel_block
+//   holds the sound with a channel's gain applied
+static int transfer_frames = 0;
+static int frame_bytes = 0;
+static int16_t *channel_block = NULL;
+static BYTE *channel_buffer = NULL;
+static int16_t *render_block = NULL;
+
+// Sound is generated into the ring buffer, and a separate audio thread 
+//   does nothing but copy it to the sink. A byte on wake_pipe tells 
+//   the audio thread that there is more to do; a byte on space_pipe
+//   tells the generating side that there is space in the ring buffer.
+//   If the audio thread fails, it stores the error in thread_error. 
+//   idle is set when there's nothing more to play for the time being, 
+//   so that the sink should play whatever it is holding back. finishing 
+//   tells the audio thread to exit once the ring buffer is empty
+static RingBuffer *ring = NULL;
+static pthread_t audio_thread;
+static BOOL thread_running = FALSE;
+static BOOL realtime = FALSE;
+static int wake_pipe[2] = {-1, -1};
+static int space_pipe[2] = {-1, -1};
+static atomic_int thread_error;
+static atomic_bool idle;
+static atomic_bool finishing;
+
+// Steady tones that have already been rendered. This must be cleared 
+//   whenever a setting changes the way tones are generated
+static ToneCache *tone_cache = NULL;
+
+/*==========================================================================
+  tonegen_set_sine_table
+  Select the size and interpolation of the sine table. A size of 
+    zero means don't use a table at all, and call sin() for each
+    sample. Returns FALSE if the size is not valid, in which case the
+    previous table is retained
 ==========================================================================*/
-static void tonegen_generate_sine (int volume, 
-                 const snd_pcm_channel_area_t *areas,
-		int count, double *_phase, int freq, int fade)
-  {
-  static double max_phase = 2. * M_PI;
-  double phase = *_phase;
-  double step = max_phase*freq/(double)RATE;
-  unsigned char *samples[1];
-  int steps [1];
-  int format_bits = snd_pcm_format_width (FORMAT);
-  unsigned int maxval = (1 << (format_bits - 1)) - 1;
-  int bps = format_bits / 8; /* bytes per sample */
-  int phys_bps = snd_pcm_format_physical_width (FORMAT) / 8;
-  int big_endian = snd_pcm_format_big_endian (FORMAT) == 1;
-  samples[0] = (((unsigned char *)areas[0].addr) 
-    + (areas[0].first / 8));
-  steps[0] = areas[0].step / 8;
-  int start_count = count;
-
-  int vol = maxval * volume / 100.0;  
-
-  while (count-- > 0) 
+BOOL tonegen_set_sine_table (int size, WavetableInterp interp)
+  {
+  LOG_IN
+  BOOL ret = TRUE;
+  tonecache_clear (tone_cache);
+  if (size == 0)
     {
-    int res, i;
-
-    res = sin(phase) * vol; 
-    if (freq == 0) res = 5;
-    if (big_endian) 
-      {
-      if (fade)
-        res = res * count / start_count;
-      for (i = 0; i < bps; i++)
-        *(samples [0] + phys_bps - 1 - i) = (res >> i * 8) & 0xff;
-      } 
-    else 
+    wavetable_destroy (sine_table);
+    sine_table = NULL;
+    }
+  else
+    {
+    Wavetable *table = wavetable_create_sine (size, interp);
+    if (table)
       {
-      if (fade)
-        res = res * count / start_count;
-      for (i = 0; i < bps; i++)
-        *(samples[0] + i) = (res >> i * 8) & 0xff;
+      wavetable_destroy (sine_table);
+      sine_table = table;
       }
-    samples[0] += steps[0];
-
-    phase += step;
-    if (phase >= max_phase)
-      phase -= max_phase;
+    else
+      ret = FALSE;
     }
-  *_phase = phase;
+  LOG_OUT
+  return ret;
   }
 
 /* ==========================================================================
-  tonegen_generate_square
-  fill the buffer with sinewave, paying attention to the starting point
+  tonegen_phase_increment
+  Get the amount by which the phase accumulator must advance, per 
+    sample, to produce the frequency freq. This is integer-only, so it
+    can be used on machines without an FPU
+==========================================================================*/
+static uint32_t tonegen_phase_increment (int freq)
+  {
+  if (freq <= 0) return 0;
+  return (uint32_t)(((uint64_t)freq << 32) / rate);
+  }
+
+/* ==========================================================================
+  tonegen_generate_silence
+  fill the block with silence 
+  Note that we must actively generate silence -- we can't just pause, 
+  because the playback buffer would underrun
+==========================================================================*/
+static void tonegen_generate_silence (int16_t *block, int count)
+  {
+  // We might think that zero would be a good sample value for silence but,  
+  //  in fact, any constant value is silent. However, setting zero in my
+  //  tests actually generates a low hiss -- no idea why
+  for (int i = 0; i < count; i++)
+    block[i] = 5;
+  }
+
+/* ==========================================================================
+  tonegen_generate_sine
+  fill the block with sinewave, paying attention to the starting point
   (phase), which will have been carried forward from the previous
   period to avoid discontinuity
 ==========================================================================*/
-static void tonegen_generate_square (int volume, 
-                const snd_pcm_channel_area_t *areas,
-		int count, double *_phase, int freq, int fade)
-  {
-  static double max_phase = 2. * M_PI;
-  double phase = *_phase;
-  double step = max_phase*freq/(double)RATE;
-  unsigned char *samples[1];
-  int steps [1];
-  int format_bits = snd_pcm_format_width (FORMAT);
-  unsigned int maxval = (1 << (format_bits - 1)) - 1;
-  int bps = format_bits / 8; /* bytes per sample */
-  int phys_bps = snd_pcm_format_physical_width (FORMAT) / 8;
-  int big_endian = snd_pcm_format_big_endian (FORMAT) == 1;
-  samples[0] = (((unsigned char *)areas[0].addr) 
-    + (areas[0].first / 8));
-  steps[0] = areas[0].step / 8;
-  int start_count = count;
-  int vol = volume * (int)maxval / 100;
-
-  while (count-- > 0) 
-    {
-    int res, i;
+static void tonegen_generate_sine (int16_t *block, int count, 
+    uint32_t *phase, int freq)
+  {
+  if (freq == 0)
+    tonegen_generate_silence (block, count);
+  else
+    kernel_sine (block, count, sine_table, phase, 
+      tonegen_phase_increment (freq), MAXVAL);
+  }
 
-    if (phase > M_PI) 
-      res = vol;
-    else 
-      res = -vol;
+/* ==========================================================================
+  tonegen_generate_square
+  fill the block with squarewave, paying attention to the starting point
+  (phase), which will have been carried forward from the previous
+  period to avoid discontinuity
+==========================================================================*/
+static void tonegen_generate_square (int16_t *block, int count, 
+    uint32_t *phase, int freq)
+  {
+  if (freq == 0)
+    tonegen_generate_silence (block, count);
+  else
+    kernel_square_blep (block, count, phase, 
+      tonegen_phase_increment (freq), MAXVAL, square_quality);
+  }
 
-    if (freq == 0) res = 5;
-    if (big_endian) 
-      {
-      if (fade)
-        res = res * count / start_count;
-      for (i = 0; i < bps; i++)
-        *(samples [0] + phys_bps - 1 - i) = (res >> i * 8) & 0xff;
-      } 
-    else 
-      {
-      if (fade)
-        res = res * count / start_count;
-      for (i = 0; i < bps; i++)
-        *(samples[0] + i) = (res >> i * 8) & 0xff;
-      }
-    samples[0] += steps[0];
+/* ==========================================================================
+  tonegen_generate_sweep
+  fill the block with a sweep, continuing from phase and the 
+  sweep state left by the previous period
+==========================================================================*/
+static void tonegen_generate_sweep (Waveform waveform, int16_t *block, 
+    int count, uint32_t *phase, KernelSweep *sweep)
+  {
+  if (waveform == waveform_square)
+    kernel_square_sweep (block, count, phase, sweep, MAXVAL, square_quality);
+  else
+    kernel_sine_sweep (block, count, sine_table, phase, sweep, MAXVAL);
+  }
 
-    phase += step;
-    if (phase >= max_phase)
-      phase -= max_phase;
+/* ==========================================================================
+  tonegen_init_sweep
+  Set up a sweep from f1 to f2 Hz over 'frames' frames. An exponential
+    sweep can't start or end at zero, so a linear sweep is used instead
+==========================================================================*/
+static void tonegen_init_sweep (KernelSweep *sweep, SweepCurve curve, 
+    int f1, int f2, int64_t frames)
+  {
+  // Phase step, without truncation, for f1 and f2
+  double s1 = f1 * (4294967296.0 / rate);
+  double s2 = f2 * (4294967296.0 / rate);
+  if (frames < 1) frames = 1;
+  sweep->step = s1;
+  if (curve == sweep_curve_exponential && f1 > 0 && f2 > 0)
+    {
+    sweep->ratio = pow (s2 / s1, 1.0 / frames);
+    sweep->delta = 0;
+    }
+  else
+    {
+    sweep->ratio = 1;
+    sweep->delta = (s2 - s1) / frames;
     }
-  *_phase = phase;
   }
 
 /* ==========================================================================
   tonegen_generate_buzz
+  The caller restarts the phase from zero every CHANGE_FRAMES frames, 
+    and it's the resulting discontinuity that makes this a buzz rather
+    than a square wave
 ==========================================================================*/
-static void tonegen_generate_buzz (const snd_pcm_channel_area_t *areas,
-		int count, int freq, int fade)
-  {
-  static double max_phase = 2. * M_PI;
-  double phase = 0;
-  double step = max_phase*freq/(double)RATE;
-  unsigned char *samples[1];
-  int steps [1];
-  int format_bits = snd_pcm_format_width (FORMAT);
-  unsigned int maxval = (1 << (format_bits - 1)) - 1;
-  int bps = format_bits / 8; /* bytes per sample */
-  int phys_bps = snd_pcm_format_physical_width (FORMAT) / 8;
-  int big_endian = snd_pcm_format_big_endian (FORMAT) == 1;
-  samples[0] = (((unsigned char *)areas[0].addr) 
-    + (areas[0].first / 8));
-  steps[0] = areas[0].step / 8;
-  int start_count = count;
-
-  while (count-- > 0) 
-    {
-    int res, i;
-
-    if (phase > M_PI)
-      res = maxval / 4;
-    else
-      res = -maxval / 4;
+static void tonegen_generate_buzz (int16_t *block, int count, 
+    uint32_t *phase, int freq)
+  {
+  kernel_square_blep (block, count, phase, 
+    tonegen_phase_increment (freq), MAXVAL / 4, square_quality);
+  }
 
-    if (big_endian) 
-      {
-      if (fade)
-        res = res * count / start_count;
-      for (i = 0; i < bps; i++)
-        *(samples [0] + phys_bps - 1 - i) = (res >> i * 8) & 0xff;
-      } 
-    else 
-      {
-      if (fade)
-        res = res * count / start_count;
-      for (i = 0; i < bps; i++)
-        *(samples[0] + i) = (res >> i * 8) & 0xff;
-      }
-    samples[0] += steps[0];
+/* ==========================================================================
+  tonegen_generate_noise
+  fill the block with white noise 
+==========================================================================*/
+static void tonegen_generate_noise (int16_t *block, int count)
+  {
+  rng_fill_noise (&rng, block, count);
+  }
 
-    phase += step;
-    if (phase >= max_phase)
-      phase -= max_phase;
-    }
+/* ==========================================================================
+  tonegen_get_channel_gain
+==========================================================================*/
+static int tonegen_get_channel_gain (int channel)
+  {
+  if (route_channels == 0) return RAMP_UNITY;
+  if (channel >= route_channels) return 0;
+  return channel_gains[channel];
   }
 
 /* ==========================================================================
-  tonegen_generate_silence
-  fill the buffer with silence 
-  Note that we must actively generate silence -- we can't just pause, 
-  because the playback buffer would underrun
+  tonegen_write_frames
+  Convert count frames from block, which holds one sample per frame, 
+    to the output format, with the sample copied to every channel at
+    that channel's gain. Channels at full volume share one conversion,
+    and silent channels aren't converted at all
 ==========================================================================*/
-static void tonegen_generate_silence (const snd_pcm_channel_area_t *areas, 
+static void tonegen_write_frames (BYTE *out, const int16_t *block, 
     int count)
   {
-  unsigned char *samples[1];
-  int steps [1];
-  int format_bits = snd_pcm_format_width (FORMAT);
-  int bps = format_bits / 8; /* bytes per sample */
-  int phys_bps = snd_pcm_format_physical_width (FORMAT) / 8;
-  int big_endian = snd_pcm_format_big_endian (FORMAT) == 1;
-  samples[0] = (((unsigned char *)areas[0].addr) 
-    + (areas[0].first / 8));
-  steps[0] = areas[0].step / 8;
-  samples[0] += 0; 
-
-  while (count-- > 0) 
+  if (channels == 1 && route_channels == 0)
     {
-    // We might think that zero would be a good sample value for silence but,  
-    //  in fact, any constant value is silent. However, setting zero in my
-    //  tests actually generates a low hiss -- no idea why
-    int res = 5, i;
+    sample_writer (out, block, count);
+    return;
+    }
 
-    if (big_endian) 
+  int bytes = sampleformat_get_bytes (sample_format);
+  // Cached tones may be longer than a period
+  while (count > 0)
+    {
+    int n = count < transfer_frames ? count : transfer_frames;
+    BOOL all_unity = TRUE;
+    for (unsigned int c = 0; c < channels; c++)
+      if (tonegen_get_channel_gain (c) != RAMP_UNITY) all_unity = FALSE;
+    if (all_unity)
       {
-      for (i = 0; i < bps; i++)
-        *(samples [0] + phys_bps - 1 - i) = (res >> i * 8) & 0xff;
-      } 
-    else 
+      sample_writer (channel_buffer, block, n);
+      sampleformat_duplicate (out, channel_buffer, n, channels, bytes);
+      }
+    else
       {
-      for (i = 0; i < bps; i++)
-        *(samples[0] + i) = (res >> i * 8) & 0xff;
+      BOOL unity_done = FALSE;
+      for (unsigned int c = 0; c < channels; c++)
+        {
+        int gain = tonegen_get_channel_gain (c);
+        if (gain == 0)
+          {
+          sampleformat_store_channel (out, NULL, n, c, channels, bytes);
+          continue;
+          }
+        if (gain != RAMP_UNITY)
+          {
+          memcpy (channel_block, block, n * sizeof (int16_t));
+          ramp_apply (channel_block, n, gain, gain, ramp_linear);
+          sample_writer (channel_buffer, channel_block, n);
+          unity_done = FALSE;
+          }
+        else if (!unity_done)
+          {
+          sample_writer (channel_buffer, block, n);
+          unity_done = TRUE;
+          }
+        sampleformat_store_channel (out, channel_buffer, n, c, channels, 
+          bytes);
+        }
       }
-    samples[0] += steps[0];
-
+    out += n * frame_bytes;
+    block += n;
+    count -= n;
     }
   }
 
+/* ==========================================================================
+  tonegen_get_cached_tone
+  Get a steady tone, rendered in the output format with the gain 
+    applied, that can be repeated indefinitely. The tone is rendered 
+    and cached if necessary, but only if it will be repeated at least
+    once in the next 'frames' frames -- otherwise it's quicker just to 
+    generate it. Returns NULL if the tone should not be cached. The 
+    rendering is always at least one period long, so no more than
+    two copies are needed to fill a period
+==========================================================================*/
+static const BYTE *tonegen_get_cached_tone (Waveform waveform, int gain, 
+    int freq, int64_t frames, int period_size, int *loop_frames)
+  {
+  if (freq <= 0) return NULL;
+  if (!tone_cache) tone_cache = tonecache_create();
+  const BYTE *data = tonecache_find (tone_cache, freq, waveform, gain,
+    loop_frames);
+  if (data) return data;
+
+  int n = tonecache_loop_frames (freq, rate);
+  if (n > frames / 2) return NULL;
+  n *= (period_size + n - 1) / n; 
+  int16_t *block = malloc (n * sizeof (int16_t));
+  uint32_t phase = 0;
+  if (waveform == waveform_square)
+    tonegen_generate_square (block, n, &phase, freq);
+  else
+    tonegen_generate_sine (block, n, &phase, freq);
+  ramp_apply (block, n, gain, gain, fade_shape);
+  BYTE *rendered = malloc (n * frame_bytes);
+  tonegen_write_frames (rendered, block, n);
+  free (block);
+  tonecache_add (tone_cache, freq, waveform, gain, rendered, n);
+  *loop_frames = n;
+  return rendered;
+  }
 
 /* ==========================================================================
-  tonegen_generate_noise
-  fill the buffer with white noise 
+  tonegen_copy_cached_tone
+  Fill the period buffer from a cached tone, starting at frame 
+    *offset of the tone, and advance *offset, wrapping round to the 
+    start of the tone
 ==========================================================================*/
-static void tonegen_generate_noise (const snd_pcm_channel_area_t *areas, 
-    int count)
+static void tonegen_copy_cached_tone (BYTE *samples, const BYTE *tone, 
+    int tone_frames, int *offset, int count, int frame_bytes)
+  {
+  while (count > 0)
+    {
+    int n = tone_frames - *offset;
+    if (n > count) n = count;
+    memcpy (samples, tone + *offset * frame_bytes, n * frame_bytes);
+    samples += n * frame_bytes;
+    count -= n;
+    *offset = (*offset + n) % tone_frames;
+    }
+  }
+
+/*=========================================================================
+  tonegen_apply_gain
+  Apply the volume, and the fade, to a block. pos is the position of 
+    the block's first frame relative to the start of the fade, so it's
+    negative until the fade starts. The fade is calculated from the 
+    position, so it's the same however the sound is divided into blocks
+==========================================================================*/
+static void tonegen_apply_gain (int16_t *block, int count, int64_t pos, 
+    int fade_frames, int gain)
   {
-  unsigned char *samples[1];
-  int steps [1];
-  int format_bits = snd_pcm_format_width (FORMAT);
-  int bps = format_bits / 8; /* bytes per sample */
-  int phys_bps = snd_pcm_format_physical_width (FORMAT) / 8;
-  int big_endian = snd_pcm_format_big_endian (FORMAT) == 1;
-  unsigned int maxval = (1 << (format_bits - 1)) - 1;
-  samples[0] = (((unsigned char *)areas[0].addr) 
-    + (areas[0].first / 8));
-  steps[0] = areas[0].step / 8;
-  samples[0] += 0; 
-
-  while (count-- > 0) 
+  if (pos < 0)
     {
-    int i;
-    int res = (double) rand() / RAND_MAX * (double) maxval;
-    if (big_endian) 
+    // Skip the part of the block before the fade
+    int n = -pos < count ? (int)-pos : count;
+    ramp_apply (block, n, gain, gain, fade_shape);
+    block += n;
+    count -= n;
+    pos = 0;
+    }
+  if (count > 0)
+    {
+    int g1, g2;
+    if (fade_shape == ramp_exponential)
       {
-      for (i = 0; i < bps; i++)
-        *(samples [0] + phys_bps - 1 - i) = (res >> i * 8) & 0xff;
-      } 
-    else 
+      // Fade to the exponential ramp's floor, rather than to zero
+      double r = (double)RAMP_EXP_FLOOR / (gain > 0 ? gain : 1);
+      g1 = gain * pow (r, (double)pos / fade_frames);
+      g2 = gain * pow (r, (double)(pos + count) / fade_frames);
+      }
+    else
       {
-      for (i = 0; i < bps; i++)
-        *(samples[0] + i) = (res >> i * 8) & 0xff;
+      g1 = (int64_t)gain * (fade_frames - pos) / fade_frames;
+      g2 = (int64_t)gain * (fade_frames - pos - count) / fade_frames;
       }
-    samples[0] += steps[0];
-
+    ramp_apply (block, count, g1, g2, fade_shape);
     }
   }
 
-  
+
 /*=========================================================================
-  tonegen_play_sound
-=========================================================================*/
-void tonegen_play_sound (snd_pcm_t *handle, SoundType sound_type, 
-    Waveform waveform, int volume,
+  tonegen_sound_init
+  Set up a sound, to be played by tonegen_fill. Durations are in msec,
+    and frequencies in Hz. pitch_duration is the time between changes
+    of pitch, for a random sound. Durations are exact to the frame 
+==========================================================================*/
+void tonegen_sound_init (TonegenSound *self, SoundType sound_type, 
+    Waveform waveform, SweepCurve curve, int volume,
     const int duration, const int pitch_duration, const int f1, 
-    const int f2, snd_pcm_sframes_t period_size)
-  {
-  double phase = 0;
-  int16_t *ptr;
-  int err, cptr;
-  int16_t *samples;
-  snd_pcm_channel_area_t *areas;
-
-  int freq = f1;
-  int time_per_period = PERIOD_TIME / 1000;
-  int loops = duration / time_per_period;
-  int f_increment = (f2 - f1) / loops;
-  int loops_per_pitch_duration = pitch_duration / time_per_period;
-  
-  samples = malloc ((period_size * 
-    snd_pcm_format_physical_width (FORMAT)) / 8);
-  areas = malloc (sizeof (snd_pcm_channel_area_t));
+    const int f2)
+  {
+  memset (self, 0, sizeof (TonegenSound));
+  self->type = sound_type;
+  self->waveform = waveform;
+  // The generators all produce full-scale output; volume and the
+  //   final fade are applied afterwards, to whatever was generated
+  self->gain = volume * RAMP_UNITY / 100;
+  self->f1 = f1;
+  self->f2 = f2;
+  self->freq = f1;
+  self->frames = (int64_t)duration * rate / 1000;
+  int64_t pitch_frames = (int64_t)pitch_duration * rate / 1000;
+  self->pitch_frames = pitch_frames > INT_MAX ? INT_MAX : pitch_frames;
+  if (self->pitch_frames <= 0) self->pitch_frames = CHANGE_FRAMES;
+  self->fade_frames = 
+    self->frames < FADE_FRAMES ? (int)self->frames : FADE_FRAMES;
+  self->fade_start = self->frames - self->fade_frames;
+  if (sound_type == sound_type_sweep)
+    tonegen_init_sweep (&self->sweep, curve, f1, f2, self->frames);
+  }
+
+
+/*=========================================================================
+  tonegen_sound_finished
+==========================================================================*/
+BOOL tonegen_sound_finished (const TonegenSound *self)
+  {
+  return self->done >= self->frames;
+  }
+
+
+/*=========================================================================
+  tonegen_sound_render
+  Put the next count frames of the sound into samples, in the output
+    format. count must be no more than is left of the sound, and no 
+    more than the transfer size
+==========================================================================*/
+static void tonegen_sound_render (TonegenSound *self, BYTE *samples, 
+    int count)
+  {
+  int64_t done = self->done;
+  int16_t *block = render_block;
 
-  areas[0].addr = samples;
-  areas[0].first = 0; 
-  areas[0].step = snd_pcm_format_physical_width (FORMAT);
+  // A steady tone is played from the cache, except for the fade. The 
+  //   cache is only consulted when the sound starts, so that sounds 
+  //   waiting to be played don't hold on to cache entries
+  if (self->type == sound_type_tone && done == 0)
+    self->tone = tonegen_get_cached_tone (self->waveform, self->gain, 
+      self->freq, self->fade_start, transfer_frames, &self->tone_frames);
 
-  int loop;
-  for (loop = 0; loop < loops; loop++)
+  if (self->type == sound_type_buzz || self->type == sound_type_random)
     {
-    if (sound_type == sound_type_buzz)
+    // Generate up to each change of pitch, and each restart of the
+    //   buzz, in turn
+    int i, n;
+    for (i = 0; i < count; i += n)
       {
-      if (loops_per_pitch_duration == 0 
-           || (loop % loops_per_pitch_duration) == 0)
+      int64_t pos = done + i;
+      if (pos % self->pitch_frames == 0)
+        self->freq = rng_range (&rng, self->f1, self->f2);
+      n = self->pitch_frames - (int)(pos % self->pitch_frames);
+      if (self->type == sound_type_buzz)
         {
-        freq = f1 + (f2 - f1) * (double) rand() / RAND_MAX ;
+        int change = pos % CHANGE_FRAMES;
+        if (change == 0) self->phase = 0;
+        if (n > CHANGE_FRAMES - change) n = CHANGE_FRAMES - change;
         }
-      tonegen_generate_buzz (areas, period_size, freq, loop == loops - 1);
-      }
-    else if (sound_type == sound_type_random)
-      {
-      if (loops_per_pitch_duration == 0 || 
-           (loop % loops_per_pitch_duration) == 0)
-        freq = f1 + (f2 - f1) * (double) rand() / RAND_MAX ;
-      if (waveform == waveform_square)
-        tonegen_generate_square (volume, areas, period_size, 
-           &phase, freq, loop == loops - 1);
+      if (n > count - i) n = count - i;
+      if (self->type == sound_type_buzz)
+        tonegen_generate_buzz (block + i, n, &self->phase, self->freq);
+      else if (self->waveform == waveform_square)
+        tonegen_generate_square (block + i, n, &self->phase, self->freq);
       else
-        tonegen_generate_sine (volume, areas, period_size, 
-           &phase, freq, loop == loops - 1);
+        tonegen_generate_sine (block + i, n, &self->phase, self->freq);
       }
-    else if (sound_type == sound_type_sweep)
-      {
-      freq += f_increment;
-      if (waveform == waveform_square)
-        tonegen_generate_square (volume, areas, period_size, 
-           &phase, freq, loop == loops - 1);
-      else
-        tonegen_generate_sine (volume, areas, period_size, 
-           &phase, freq, loop == loops - 1);
-      }
-    else if (sound_type == sound_type_tone)
+    }
+  else if (self->type == sound_type_sweep)
+    {
+    tonegen_generate_sweep (self->waveform, block, count, &self->phase, 
+      &self->sweep);
+    }
+  else if (self->type == sound_type_tone)
+    {
+    if (self->tone && done + count <= self->fade_start)
       {
-      if (waveform == waveform_square)
-        tonegen_generate_square (volume, areas, period_size, &phase, 
-          freq, loop == loops - 1);
-      else
-        tonegen_generate_sine (volume, areas, period_size, &phase, 
-          freq, loop == loops - 1);
+      tonegen_copy_cached_tone (samples, self->tone, self->tone_frames, 
+        &self->tone_offset, count, frame_bytes);
+      // Keep the phase in step, for the fade
+      self->phase += (uint32_t)count * tonegen_phase_increment (self->freq);
+      self->done += count;
+      return;
       }
-    else if (sound_type == sound_type_noise)
-      tonegen_generate_noise (areas, period_size);
+    else if (self->waveform == waveform_square)
+      tonegen_generate_square (block, count, &self->phase, self->freq);
     else
-      tonegen_generate_silence (areas, period_size);
-    ptr = samples;
-    cptr = period_size;
-    while (cptr > 0) 
-      {
-      err = snd_pcm_writei (handle, ptr, cptr);
-      if (err == -EAGAIN)
-        continue;
-      if (err < 0) 
-        {
-        printf ("hello %d\n", err);
-        // Underrun -- should never happen
-        break; 
-        }
-      ptr += err;
-      cptr -= err;
-      }
+      tonegen_generate_sine (block, count, &self->phase, self->freq);
     }
-
-  free(areas);
-  free(samples);
-  }
-
-
-/*==========================================================================
-  tonegen_setup_hw_params
- 
-  Set up the ALSA hardware paramters, and return the available buffer
-    size and period size -- which may not be exactly what were requested
-==========================================================================*/
-static int tonegen_set_hwparams(snd_pcm_t *handle, 
-                snd_pcm_hw_params_t *params, 
-                snd_pcm_sframes_t *buffer_size, 
-                snd_pcm_sframes_t *period_size)
-  {
-  unsigned int rrate;
-  snd_pcm_uframes_t size;
-  int err, dir = 0;
-  err = snd_pcm_hw_params_any(handle, params);
-  if (err < 0) 
+  else if (self->type == sound_type_noise)
     {
-    log_error ("No configurations available: %s",
-       snd_strerror(err));
-    return err;
+    tonegen_generate_noise (block, count);
     }
-  err = snd_pcm_hw_params_set_access (handle, params, 
-    SND_PCM_ACCESS_RW_INTERLEAVED);
-  if (err < 0) 
+  else
     {
-    log_error ("Access type not available: %s", snd_strerror(err));
-    return err;
+    tonegen_generate_silence (block, count);
     }
-  err = snd_pcm_hw_params_set_format (handle, params, FORMAT);
-  if (err < 0) 
+  tonegen_apply_gain (block, count, done - self->fade_start, 
+    self->fade_frames, self->gain);
+  tonegen_write_frames (samples, block, count);
+  self->done += count;
+  }
+
+  
+/*=========================================================================
+  tonegen_notify
+  Write a byte to a pipe, to wake up whatever is waiting for it. If the 
+    pipe is full, there's already a wakeup waiting
+==========================================================================*/
+static void tonegen_notify (int fd)
+  {
+  BYTE b = 0;
+  write (fd, &b, 1);
+  }
+
+/*=========================================================================
+  tonegen_clear_notifications
+  Read all the bytes waiting in a pipe. The pipe is non-blocking
+==========================================================================*/
+static void tonegen_clear_notifications (int fd)
+  {
+  BYTE buff[64];
+  while (read (fd, buff, sizeof (buff)) > 0)
+    ;
+  }
+
+/*=========================================================================
+  tonegen_feed
+  In the audio thread, copy everything in the ring buffer to the sink, 
+    a period at a time. The sink waits for space, if it plays in real
+    time. Returns zero, or a negative error code if the sink has failed
+==========================================================================*/
+static int tonegen_feed (void)
+  {
+  for (;;)
     {
-    log_error ("Sample format not available: %s", 
-      snd_strerror(err));
-    return err;
+    int count;
+    const BYTE *data = ringbuffer_read_ptr (ring, &count);
+    if (count == 0) break;
+    if (count > transfer_frames) count = transfer_frames;
+    int err = sink_write (sink, data, count);
+    if (err < 0) return err;
+    ringbuffer_read_advance (ring, count);
+    tonegen_notify (space_pipe[1]);
     }
-  err = snd_pcm_hw_params_set_channels (handle, params, 1);
-  if (err < 0) 
+  return 0;
+  }
+
+/*=========================================================================
+  tonegen_audio_thread
+  Keep the sink fed from the ring buffer, sleeping in poll() until 
+    there's something in the ring buffer. When the ring buffer runs dry
+    and there's nothing more to play for the time being, tell the sink
+    to play whatever it is holding back -- an ALSA device that hasn't
+    reached its start threshold, for example
+==========================================================================*/
+static void *tonegen_audio_thread (void *data)
+  {
+  (void)data;
+  struct pollfd pfd;
+  pfd.fd = wake_pipe[0];
+  pfd.events = POLLIN;
+
+  for (;;)
     {
-    log_error ("Can't set mono playback: %s",  
-      snd_strerror(err));
-    return err;
+    int err = tonegen_feed ();
+    if (err < 0)
+      {
+      atomic_store (&thread_error, err);
+      tonegen_notify (space_pipe[1]);
+      break;
+      }
+    if (ringbuffer_read_space (ring) == 0)
+      {
+      if (atomic_load (&finishing)) break;
+      if (atomic_exchange (&idle, FALSE)) 
+        sink_start (sink);
+      }
+    pfd.revents = 0;
+    if (poll (&pfd, 1, -1) < 0 && errno != EINTR)
+      {
+      atomic_store (&thread_error, -errno);
+      tonegen_notify (space_pipe[1]);
+      break;
+      }
+    if (pfd.revents & POLLIN)
+      tonegen_clear_notifications (wake_pipe[0]);
     }
-  rrate = RATE;
-  err = snd_pcm_hw_params_set_rate_near (handle, params, &rrate, 0);
-  if (err < 0) 
+  return NULL;
+  }
+
+/*=========================================================================
+  tonegen_close_pipes
+  Close whichever ends of the pipes are open
+==========================================================================*/
+static void tonegen_close_pipes (void)
+  {
+  for (int i = 0; i < 2; i++)
     {
-    log_error ("Rate %iHz not available: %s", 
-        RATE, snd_strerror(err));
-    return err;
+    if (wake_pipe[i] >= 0) close (wake_pipe[i]);
+    if (space_pipe[i] >= 0) close (space_pipe[i]);
+    wake_pipe[i] = space_pipe[i] = -1;
     }
-  if (rrate != RATE) 
+  }
+
+/*=========================================================================
+  tonegen_start_thread
+  Create the ring buffer, and start the audio thread. If real-time 
+    scheduling was asked for, but isn't permitted, a normal thread is 
+    used instead
+==========================================================================*/
+static BOOL tonegen_start_thread (void)
+  {
+  LOG_IN
+  ringbuffer_destroy (ring);
+  ring = ringbuffer_create (transfer_frames * RING_PERIODS, frame_bytes);
+  if (!ring)
     {
-    log_warning ("Warning: Rate not available (requested %iHz, get %iHz)\n", 
-       RATE, err);
+    log_error ("Can't allocate ring buffer");
+    LOG_OUT
+    return FALSE;
     }
-  unsigned int buffer_time = BUFFER_TIME;
-  err = snd_pcm_hw_params_set_buffer_time_near (handle, params, 
-    &buffer_time, &dir);
-  if (err < 0) 
+  tonegen_close_pipes ();
+  if (pipe (wake_pipe) < 0 || pipe (space_pipe) < 0)
     {
-    log_error ("Unable to set buffer time %i: %s\n", 
-      buffer_time, snd_strerror(err));
-    return err;
+    log_error ("Can't create pipe: %s", strerror (errno));
+    tonegen_close_pipes ();
+    LOG_OUT
+    return FALSE;
     }
-  err = snd_pcm_hw_params_get_buffer_size(params, &size);
-  if (err < 0) 
+  for (int i = 0; i < 2; i++)
     {
-    log_error ("Unable to get buffer size: %s\n", 
-      snd_strerror(err));
-    return err;
+    fcntl (wake_pipe[i], F_SETFL, O_NONBLOCK);
+    fcntl (space_pipe[i], F_SETFL, O_NONBLOCK);
     }
-  *buffer_size = size;
+  atomic_store (&thread_error, 0);
+  atomic_store (&idle, FALSE);
+  atomic_store (&finishing, FALSE);
 
-  //snd_pcm_sframes_t buffer_size = size;
-  unsigned int period_time = PERIOD_TIME;
-  err = snd_pcm_hw_params_set_period_time_near (handle, params, 
-      &period_time, &dir);
-  if (err < 0) 
-    {
-    log_error ("Unable to set period time %i: %s\n", 
-      period_time, snd_strerror(err));
-    return err;
-    }
-  err = snd_pcm_hw_params_get_period_size (params, &size, &dir);
-  if (err < 0) 
+  int err = -1;
+  if (realtime)
     {
-    log_error ("Unable to get period size: %s\n", 
-      snd_strerror(err));
-    return err;
+    // Page faults would hold up the audio thread, so lock everything 
+    //   into memory
+    if (mlockall (MCL_CURRENT | MCL_FUTURE) < 0)
+      log_warning ("Can't lock memory: %s", strerror (errno));
+    pthread_attr_t attr;
+    struct sched_param param;
+    memset (&param, 0, sizeof (param));
+    param.sched_priority = REALTIME_PRIORITY;
+    pthread_attr_init (&attr);
+    pthread_attr_setinheritsched (&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy (&attr, SCHED_FIFO);
+    pthread_attr_setschedparam (&attr, &param);
+    err = pthread_create (&audio_thread, &attr, tonegen_audio_thread, 
+      NULL);
+    pthread_attr_destroy (&attr);
+    if (err != 0)
+      log_warning ("Can't use real-time scheduling: %s", strerror (err));
+    else
+      log_debug ("Audio thread is SCHED_FIFO, priority %d", 
+        REALTIME_PRIORITY);
     }
-  *period_size = size;
-  err = snd_pcm_hw_params (handle, params);
-  if (err < 0) 
+  if (err != 0)
+    err = pthread_create (&audio_thread, NULL, tonegen_audio_thread, 
+      NULL);
+  if (err != 0)
     {
-    log_error ("Unable to set hwparams: %s\n", snd_strerror(err));
-    return err;
+    log_error ("Can't start audio thread: %s", strerror (err));
+    LOG_OUT
+    return FALSE;
     }
-  return 0;
+  thread_running = TRUE;
+  LOG_OUT
+  return TRUE;
   }
 
-/*==========================================================================
-  tonegen_setup_sw_params
-  
-  Set up buffering based on the buffer size and period size returned
-    by the hardware
+/*=========================================================================
+  tonegen_stop_thread
+  Wait for the audio thread to send everything in the ring buffer to 
+    the sink, and exit
 ==========================================================================*/
-static int tonegen_set_swparams(snd_pcm_t *handle, 
-        snd_pcm_sw_params_t *swparams, 
-        snd_pcm_sframes_t buffer_size, snd_pcm_sframes_t period_size)
+static void tonegen_stop_thread (void)
   {
-  int err;
-  err = snd_pcm_sw_params_current(handle, swparams);
-  if (err < 0) 
-    {
-    log_error ("Unable to determine current swparams: %s\n", 
-      snd_strerror(err));
-    return err;
-    }
-  err = snd_pcm_sw_params_set_start_threshold (handle, swparams, 
-    (buffer_size / period_size) * period_size);
-  if (err < 0) 
-    {
-    log_error ("Unable to set start threshold: %s", 
-      snd_strerror(err));
-    return err;
-    }
-  err = snd_pcm_sw_params_set_avail_min (handle, swparams, period_size);
-  if (err < 0) 
-    {
-    log_error ("Unable to set avail min for playback: %s", 
-      snd_strerror(err));
-    return err;
-    }
-  err = snd_pcm_sw_params(handle, swparams);
-  if (err < 0)  
+  if (!thread_running) return;
+  atomic_store (&finishing, TRUE);
+  tonegen_notify (wake_pipe[1]);
+  pthread_join (audio_thread, NULL);
+  thread_running = FALSE;
+  }
+
+/*=========================================================================
+  tonegen_get_output_fd
+  Get the descriptor that becomes readable when there's space for more
+    sound, or when the audio thread has failed. Either way, 
+    tonegen_fill() should be called
+==========================================================================*/
+int tonegen_get_output_fd (void)
+  {
+  return space_pipe[0];
+  }
+
+/*=========================================================================
+  tonegen_fill
+  Generate as much of the sound as there is space for, without waiting,
+    and pass it to the audio thread. Returns the number of frames 
+    generated, which may be zero, or a negative error code if the 
+    sink has failed. Call this again, when tonegen_get_output_fd()
+    is readable, until tonegen_sound_finished() is TRUE 
+==========================================================================*/
+int tonegen_fill (TonegenSound *sound)
+  {
+  tonegen_clear_notifications (space_pipe[0]);
+  int err = atomic_load (&thread_error);
+  if (err < 0) return err;
+
+  int written = 0;
+  while (!tonegen_sound_finished (sound))
     {
-    log_error ("Unable to set sw params for playback: %s", 
-      snd_strerror(err));
-    return err;
+    int64_t left = sound->frames - sound->done;
+    int count = left > transfer_frames ? transfer_frames : (int)left;
+    if (ringbuffer_write_space (ring) < count) break;
+    // This may reduce count, if the ring buffer wraps round
+    int n;
+    BYTE *samples = ringbuffer_write_ptr (ring, &n);
+    if (count > n) count = n;
+    atomic_store (&idle, FALSE);
+    tonegen_sound_render (sound, samples, count);
+    ringbuffer_write_advance (ring, count);
+    written += count;
     }
-  return 0;
+  if (written > 0) tonegen_notify (wake_pipe[1]);
+  return written;
+  }
+
+
+/*=========================================================================
+  tonegen_start
+  Tell the audio thread that there is nothing more to play for the time
+    being -- when waiting for input, for example. Once everything 
+    generated so far has been sent to the sink, the sink plays anything
+    it is holding back. An ALSA device starts, if it hasn't already, 
+    even though the start threshold hasn't been reached; it will 
+    probably run out of sound before there is more, but that doesn't 
+    count as an underrun
+==========================================================================*/
+void tonegen_start (void)
+  {
+  atomic_store (&idle, TRUE);
+  tonegen_notify (wake_pipe[1]);
+  }
+
+/*=========================================================================
+  tonegen_get_stats
+  Get the output counters, since the sink was opened
+==========================================================================*/
+void tonegen_get_stats (SinkStats *s)
+  {
+  if (sink)
+    sink_get_stats (sink, s);
+  else
+    memset (s, 0, sizeof (SinkStats));
   }
 
+/*=========================================================================
+  tonegen_print_stats
+==========================================================================*/
+void tonegen_print_stats (FILE *f)
+  {
+  if (sink) sink_print_stats (sink, f);
+  }
 
 /*==========================================================================
   tonegen_setup_sound 
+  Open the sink, given as TYPE[:TARGET], with the requested format, 
+    rate, channels and buffering, and start the audio thread. The 
+    sample format, rate and channels are whatever the sink actually
+    provides. *period_size is set to the most frames that are 
+    generated at once
 ==========================================================================*/
-BOOL tonegen_setup_sound (snd_pcm_t **handle, const char *device, 
-     snd_pcm_sframes_t *period_size)
+BOOL tonegen_setup_sound (const char *sink_spec, const char *format, 
+     int *period_size)
   {
   LOG_IN
-  BOOL ret = TRUE;
-  snd_pcm_hw_params_t *hwparams;
-  snd_pcm_sw_params_t *swparams;
-  snd_pcm_hw_params_alloca (&hwparams);
-  snd_pcm_sw_params_alloca (&swparams);
-  int err;
-  if ((err = snd_pcm_open (handle, device, SND_PCM_STREAM_PLAYBACK, 0)) < 0) 
-    {
-    log_error ("Can't open playback device %s: %s", device, 
-      snd_strerror(err));
-    ret = FALSE;  
-    }
+  BOOL ret = FALSE;
+  SinkConfig config;
+  memset (&config, 0, sizeof (config));
+  config.format = format;
+  config.rate = requested_rate;
+  config.channels = requested_channels > 0 ? requested_channels : 
+    route_channels;
+  config.buffer_time = buffer_time;
+  config.period_time = period_time;
+  config.start_time = start_time;
 
-  snd_pcm_sframes_t buffer_size = 0;
-  if (ret && (err = tonegen_set_hwparams (*handle, hwparams, 
-        &buffer_size, period_size)) < 0) 
+  sink_close (sink);
+  sink = sink_open (sink_spec, &config);
+  if (sink)
     {
-    log_error ("Can't set hwparams: %s", snd_strerror(err));
-    ret = FALSE;  
-    }
-  if (ret && (err = tonegen_set_swparams (*handle, swparams,  
-      buffer_size, *period_size)) < 0) 
-    {
-    log_error ("Can't set swparams: %s", snd_strerror(err));
-    ret = FALSE;
+    sample_format = config.sample_format;
+    sample_writer = sampleformat_get_writer (sample_format);
+    if (config.rate > 0) rate = config.rate;
+    channels = config.channels;
+    transfer_frames = config.period_frames;
+    *period_size = transfer_frames;
+    frame_bytes = sampleformat_get_bytes (sample_format) * channels;
+    free (render_block);
+    render_block = malloc (transfer_frames * sizeof (int16_t));
+    free (channel_block);
+    channel_block = malloc (transfer_frames * sizeof (int16_t));
+    free (channel_buffer);
+    channel_buffer = malloc (transfer_frames 
+      * sampleformat_get_bytes (sample_format));
+    // Cached tones depend on the format, rate and channels
+    tonecache_clear (tone_cache);
+    ret = tonegen_start_thread ();
     }
   LOG_OUT
   return ret;
@@ -572,22 +926,224 @@ BOOL tonegen_setup_sound (snd_pcm_t **handle, const char *device,
   
 /*==========================================================================
   tonegen_wait
-  Wait for playback buffer to empty. 
+  Wait until everything that has been generated has actually been 
+    played. The audio thread stops once it has sent everything to the
+    sink, and then the sink finishes playing whatever it holds
+==========================================================================*/
+void tonegen_wait (void)
+  {
+  LOG_IN
+  tonegen_stop_thread ();
+  if (sink) sink_drain (sink);
+  LOG_OUT
+  }
+
+/*==========================================================================
+  tonegen_set_latency
+  Select the buffering profile -- "normal" or "low". Returns FALSE if
+    the profile doesn't exist, in which case the settings are unchanged.
+    This must be called before tonegen_setup_sound
 ==========================================================================*/
-void tonegen_wait (snd_pcm_t *handle)
+BOOL tonegen_set_latency (const char *profile)
   {
-  snd_pcm_drain (handle);
-  snd_pcm_state_t state; 
-  int wait_count = 0;
-  do
+  int n = sizeof (latency_profiles) / sizeof (LatencyProfile);
+  for (int i = 0; i < n; i++)
     {
-    state = snd_pcm_state (handle);
-    usleep (100000);
-    wait_count++;
-    // Something is odd here -- the state doesn't seem
-    //   to change as it should. We have to just use a
-    //   delay arrived at by trial and error
-    } while (state == SND_PCM_STATE_RUNNING && wait_count < 50); 
+    if (strcasecmp (latency_profiles[i].name, profile) == 0)
+      {
+      buffer_time = latency_profiles[i].buffer_time;
+      period_time = latency_profiles[i].period_time;
+      start_time = latency_profiles[i].start_time;
+      return TRUE;
+      }
+    }
+  log_error ("Unknown latency profile: %s", profile);
+  return FALSE;
+  }
+
+/*==========================================================================
+  tonegen_set_buffering
+  Override the buffer time, period time, and start time (all in usec)
+    of the latency profile. A value less than zero leaves the profile's
+    setting unchanged. A start time of zero means start when the buffer 
+    is full. The device may not be able to provide exactly what's 
+    asked for. This must be called before tonegen_setup_sound
+==========================================================================*/
+void tonegen_set_buffering (int buffer, int period, int start)
+  {
+  if (buffer >= 0) buffer_time = buffer;
+  if (period >= 0) period_time = period;
+  if (start >= 0) start_time = start;
+  }
+
+/*==========================================================================
+  tonegen_request_rate
+  Ask for a specific sample rate, in Hz, or zero to let the sink
+    choose. This must be called before tonegen_setup_sound
+==========================================================================*/
+void tonegen_request_rate (int hz)
+  {
+  requested_rate = hz > 0 ? hz : 0;
+  }
+
+/*==========================================================================
+  tonegen_request_channels
+  Ask for a specific number of channels, or zero to use mono if the
+    sink supports it. This must be called before tonegen_setup_sound
+==========================================================================*/
+void tonegen_request_channels (int n)
+  {
+  requested_channels = n > 0 ? n : 0;
+  }
+
+/*==========================================================================
+  tonegen_set_route
+  Set the volume of each channel, as a percentage, starting with the 
+    first. Channels after the last one given are silent. A count of 
+    zero puts the sound on all channels at full volume. Returns FALSE 
+    if there are more channels than we can route
+==========================================================================*/
+BOOL tonegen_set_route (const int *percent, int count)
+  {
+  if (count > TONEGEN_MAX_CHANNELS)
+    {
+    log_error ("Can't route more than %d channels", TONEGEN_MAX_CHANNELS);
+    return FALSE;
+    }
+  for (int i = 0; i < count; i++)
+    {
+    int p = percent[i];
+    if (p < 0) p = 0;
+    if (p > 100) p = 100;
+    channel_gains[i] = p * RAMP_UNITY / 100;
+    }
+  route_channels = count;
+  tonecache_clear (tone_cache);
+  return TRUE;
+  }
+
+/*==========================================================================
+  tonegen_get_rate
+  Get the sample rate in use, which is only known for certain after
+    tonegen_setup_sound
+==========================================================================*/
+int tonegen_get_rate (void)
+  {
+  return rate;
+  }
+
+/*==========================================================================
+  tonegen_set_realtime
+  Run the audio thread with real-time (SCHED_FIFO) scheduling, and lock
+    the program's memory, so that page faults don't delay it. This 
+    needs privileges -- if they're lacking, a warning is given, and 
+    normal scheduling is used. This must be called before 
+    tonegen_setup_sound
+==========================================================================*/
+void tonegen_set_realtime (BOOL rt)
+  {
+  realtime = rt;
   }
 
+/*==========================================================================
+  tonegen_set_kernel
+  Select the block kernels used to generate tones -- "auto" for the best
+    this CPU supports, or a specific set such as "scalar". Returns FALSE
+    if the requested set is not available, in which case the best 
+    available set is used. The selection is made once, before playback
+==========================================================================*/
+BOOL tonegen_set_kernel (const char *name)
+  {
+  tonecache_clear (tone_cache);
+  return kernel_select (name);
+  }
+
+/*==========================================================================
+  tonegen_set_square_quality
+  Set the amount of band-limiting for square waves and buzzes, from
+    zero (none -- the naive waveform) to KERNEL_MAX_QUALITY. Higher 
+    values produce less aliasing, at a higher cost
+==========================================================================*/
+void tonegen_set_square_quality (int quality)
+  {
+  if (quality < 0) quality = 0;
+  if (quality > KERNEL_MAX_QUALITY) quality = KERNEL_MAX_QUALITY;
+  square_quality = quality;
+  tonecache_clear (tone_cache);
+  }
+
+/*==========================================================================
+  tonegen_get_square_quality
+  Get the square wave quality in use, after it has been limited to the
+    range that tonegen_set_square_quality allows
+==========================================================================*/
+int tonegen_get_square_quality (void)
+  {
+  return square_quality;
+  }
+
+/*==========================================================================
+  tonegen_set_fade_shape
+  Set the shape of the fade applied to the last period of each sound
+==========================================================================*/
+void tonegen_set_fade_shape (RampShape shape)
+  {
+  fade_shape = shape;
+  }
+
+
+/*==========================================================================
+  tonegen_set_seed
+  Seed the generator used for noise and random pitches. The same seed
+    always produces the same sequence of sounds
+==========================================================================*/
+void tonegen_set_seed (uint64_t seed)
+  {
+  rng_seed (&rng, seed);
+  }
+
+/*==========================================================================
+  tonegen_benchmark
+  Time the generation kernels, with the current settings, and print 
+    the results to f. This doesn't need the sound device to be set up
+==========================================================================*/
+void tonegen_benchmark (FILE *f)
+  {
+  bench_run (f, sine_table);
+  }
+
+/*==========================================================================
+  tonegen_measure_kernel
+  Get the time to generate one sample with a kernel, in nanoseconds, 
+    using the current sine table
+==========================================================================*/
+double tonegen_measure_kernel (BenchKernel kernel)
+  {
+  return bench_measure (kernel, sine_table);
+  }
+
+/*==========================================================================
+  tonegen_cleanup
+  Free any memory allocated by tonegen_set_sine_table, any cached
+    tones, and the transfer buffers, stop the audio thread if it's 
+    still running, and close the sink
+==========================================================================*/
+void tonegen_cleanup (void)
+  {
+  tonegen_stop_thread ();
+  sink_close (sink);
+  sink = NULL;
+  tonegen_set_sine_table (0, wavetable_interp_none);
+  tonecache_destroy (tone_cache);
+  tone_cache = NULL;
+  ringbuffer_destroy (ring);
+  ring = NULL;
+  tonegen_close_pipes ();
+  free (render_block);
+  render_block = NULL;
+  free (channel_block);
+  channel_block = NULL;
+  free (channel_buffer);
+  channel_buffer = NULL;
+  }
 
@@ -8,29 +8,98 @@
 
 #pragma once
 
+#include <stdio.h>
 #include <stdint.h>
 #include "defs.h"
+#include "wavetable.h"
+#include "ramp.h"
+#include "kernel.h"
+#include "sink.h"
+#include "bench.h"
 
 // Types of sound available
 typedef enum {sound_type_random=0, sound_type_sweep, sound_type_silence,
   sound_type_noise, sound_type_buzz, sound_type_tone} 
   SoundType;
 
+#define SOUND_TYPE_COUNT 6
+
+// Most channels that tonegen_set_route can set the volume of
+#define TONEGEN_MAX_CHANNELS 32
+
 // Types of waveform available
 typedef enum {waveform_sine=0, waveform_square}
   Waveform;
 
+// How the frequency changes during a sweep -- by the same number of
+//   Hz, or the same fraction of an octave, per sample
+typedef enum {sweep_curve_linear=0, sweep_curve_exponential}
+  SweepCurve;
+
+// A sound in progress. It's set up by tonegen_sound_init, and then 
+//   played a piece at a time by tonegen_fill. The fields are private 
+//   to tonegen.c
+typedef struct _TonegenSound
+  {
+  SoundType type;
+  Waveform waveform;
+  int gain;
+  int f1, f2, freq;
+  // Length of the sound, and how much has been played, in frames. 
+  //   These are 64-bit, as a long sound can be more than 2^31 frames
+  int64_t frames, done;
+  int pitch_frames;
+  int64_t fade_start;
+  int fade_frames;
+  uint32_t phase;
+  KernelSweep sweep;
+  const BYTE *tone;
+  int tone_frames, tone_offset;
+  } TonegenSound;
+
 BEGIN_DECLS
 
-BOOL       tonegen_setup_sound (snd_pcm_t **handle, const char *device, 
-             snd_pcm_sframes_t *period_size);
+BOOL       tonegen_setup_sound (const char *sink_spec, const char *format, 
+             int *period_size);
 
-void      tonegen_play_sound (snd_pcm_t *handle, SoundType sound_type, 
-              Waveform waveform, int volume,
+void      tonegen_sound_init (TonegenSound *self, SoundType sound_type, 
+              Waveform waveform, SweepCurve curve, int volume,
               const int duration, const int sub_duration, const int f1, 
-              const int f2, snd_pcm_sframes_t period_size);
+              const int f2);
+BOOL      tonegen_sound_finished (const TonegenSound *self);
+
+int       tonegen_fill (TonegenSound *sound);
+void      tonegen_start (void);
+int       tonegen_get_output_fd (void);
+
+void      tonegen_get_stats (SinkStats *stats);
+void      tonegen_print_stats (FILE *f);
+
+void      tonegen_wait (void);
+
+BOOL      tonegen_set_sine_table (int size, WavetableInterp interp);
+
+BOOL      tonegen_set_kernel (const char *name);
+
+BOOL      tonegen_set_latency (const char *profile);
+void      tonegen_set_buffering (int buffer_time, int period_time, 
+            int start_time);
+
+void      tonegen_request_rate (int hz);
+int       tonegen_get_rate (void);
+void      tonegen_request_channels (int n);
+BOOL      tonegen_set_route (const int *percent, int count);
+void      tonegen_set_realtime (BOOL realtime);
+void      tonegen_set_seed (uint64_t seed);
+
+void      tonegen_set_square_quality (int quality);
+int       tonegen_get_square_quality (void);
+void      tonegen_set_fade_shape (RampShape shape);
+
+void      tonegen_benchmark (FILE *f);
+double    tonegen_measure_kernel (BenchKernel kernel);
 
-void      tonegen_wait (snd_pcm_t *handle);
+void      tonegen_cleanup (void);
 
 END_DECLS
 
@@ -22,14 +22,38 @@
 void usage_show (FILE *fout, const char *argv0)
   {
   fprintf (fout, "Usage: %s [options]\n", argv0);
+  fprintf (fout, "     --analyze            show the length and cost of the sounds, and exit\n");
+  fprintf (fout, "     --benchmark          time the tone generators and exit\n");
+  fprintf (fout, "     --buffer-time=N      device buffer length, msec\n");
   fprintf (fout, "  -b,--buzz=time,f1       play buzz of f1 Hz\n");
+  fprintf (fout, "     --channels=N         number of output channels\n");
+  fprintf (fout, "     --curve=N            sweep curve, 0=linear 1=exponential\n");
   fprintf (fout, "  -d,--device=D           set ALSA device\n");
+  fprintf (fout, "     --fade=S             fade shape, linear or exponential\n");
+  fprintf (fout, "     --format=F           sample format, e.g., S16_LE\n");
   fprintf (fout, "  -h,--help               show this message\n");
+  fprintf (fout, "     --kernel=K           auto, scalar, sse2, avx2, neon\n");
+  fprintf (fout, "     --latency=L          buffering profile, normal or low\n");
   fprintf (fout, "  -l,--list={sounds}      list of sounds -- see manual\n");
+  fprintf (fout, "     --list-file=FILE     play the list of sounds in FILE\n");
+  fprintf (fout, "     --load-compiled=FILE play a list saved by --save-compiled\n");
   fprintf (fout, "  -n,--noise=time         play noise\n");
   fprintf (fout, "  -o,--log-level=N        log level, 0-5 (default 2)\n");
+  fprintf (fout, "     --output=FILE        write a WAV file (- for stdout)\n");
+  fprintf (fout, "     --period-time=N      device period length, msec\n");
   fprintf (fout, "  -r,--random=time,time2,f1,f2\n");
   fprintf (fout, "     play random tones of length time2, in range f1-f2 Hz\n");
+  fprintf (fout, "     --rate=N             sample rate, Hz (default 48000)\n");
+  fprintf (fout, "     --realtime           real-time scheduling for audio thread\n");
+  fprintf (fout, "     --route=v1,v2...     volume (%%) of each channel\n");
+  fprintf (fout, "     --save-compiled=FILE compile the list to FILE, and exit\n");
+  fprintf (fout, "     --seed=N             random seed, for repeatable output\n");
+  fprintf (fout, "     --sine-interp=I      sine interpolation, none or linear\n");
+  fprintf (fout, "     --sine-table=N       sine table size, or 0 to use sin()\n");
+  fprintf (fout, "     --sink=T[:target]    output: alsa, wav:file, raw[:file], null\n");
+  fprintf (fout, "     --start-threshold=N  msec queued before playback starts\n");
+  fprintf (fout, "     --stats              show playback counters at the end\n");
+  fprintf (fout, "     --square-quality=N   square wave band-limiting, 0-2\n");
   fprintf (fout, "  -s,--sweep=time,f1      play sweep from f1 to f2\n");
   fprintf (fout, "  -t,--tone=time,f1       play constant tone of f1 Hz\n");
   fprintf (fout, "  -v,--version            show version\n");
@@ -0,0 +1,39 @@
+/*============================================================================
+
+  tonegen 
+  wavetable.h
+  Copyright (c)2020 Kevin Boone, GPL v3.0
+
+============================================================================*/
+
+#pragma once
+
+#include <stdint.h>
+#include "defs.h"
+
+// Default number of entries in the sine table. With linear interpolation,
+//   a 1024-entry table is more accurate than 16-bit output can represent
+#define WAVETABLE_DEFAULT_SIZE 1024
+
+// Limits on the table size, which must be a power of two
+#define WAVETABLE_MIN_SIZE 64
+#define WAVETABLE_MAX_SIZE 65536
+
+// How to calculate values that fall between table entries
+typedef enum {wavetable_interp_none=0, wavetable_interp_linear}
+  WavetableInterp;
+
+struct _Wavetable;
+typedef struct _Wavetable Wavetable;
+
+BEGIN_DECLS
+
+Wavetable  *wavetable_create_sine (int size, WavetableInterp interp);
+void        wavetable_destroy (Wavetable *self);
+double      wavetable_lookup (const Wavetable *self, uint32_t phase);
+const float *wavetable_get_data (const Wavetable *self);
+int         wavetable_get_bits (const Wavetable *self);
+WavetableInterp wavetable_get_interp (const Wavetable *self);
+BOOL        wavetable_parse_interp (const char *s, WavetableInterp *interp);
+
+END_DECLS
@@ -0,0 +1,239 @@
+/*==========================================================================
+
+  tonegen
+  script_load_test.c
+  Copyright (c)2020 Kevin Boone
+  Distributed under the terms of the GPL v3.0
+
+  Loads hand-made compiled lists, with values that the compiler would 
+  never produce, and checks that script_load rejects or limits them.
+  Run with "make test".
+
+==========================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "defs.h"
+#include "log.h"
+#include "tonegen.h"
+#include "script.h"
+
+static int failures = 0;
+
+#define CHECK(x) \
+  if (!(x)) { fprintf (stderr, "%s:%d: failed: %s\n", __FILE__, \
+    __LINE__, #x); failures++; }
+
+/*==========================================================================
+  quiet_log
+  Rejected files are logged as errors, which is expected here
+==========================================================================*/
+static void quiet_log (int level, const char *message)
+  {
+  }
+
+/*==========================================================================
+  put32
+==========================================================================*/
+static void put32 (FILE *f, int32_t v)
+  {
+  uint32_t u = v;
+  BYTE b[4] = {u, u >> 8, u >> 16, u >> 24};
+  fwrite (b, 4, 1, f);
+  }
+
+/*==========================================================================
+  put_event
+==========================================================================*/
+static void put_event (FILE *f, int op, int sound_type, int v0, int v1, 
+     int v2, int v3)
+  {
+  put32 (f, op); put32 (f, sound_type);
+  put32 (f, v0); put32 (f, v1); put32 (f, v2); put32 (f, v3);
+  }
+
+/*==========================================================================
+  write_header
+  Start a version 2 file with no definitions, and count main events
+==========================================================================*/
+static FILE *write_header (const char *filename, int count)
+  {
+  FILE *f = fopen (filename, "wb");
+  fwrite ("TGSC", 4, 1, f);
+  put32 (f, 2); put32 (f, 0); put32 (f, count);
+  return f;
+  }
+
+/*==========================================================================
+  test_limits
+  Settings out of range are clamped, and a repeat with no sound plays
+    once
+==========================================================================*/
+static void test_limits (const char *filename)
+  {
+  FILE *f = write_header (filename, 7);
+  put_event (f, script_op_volume, 0, 500, 0, 0, 0);
+  put_event (f, script_op_wave, 0, 7, 0, 0, 0);
+  put_event (f, script_op_curve, 0, -3, 0, 0, 0);
+  put_event (f, script_op_repeat, 0, 2000000000, 3, 0, 0);
+  put_event (f, script_op_volume, 0, -20, 0, 0, 0);
+  put_event (f, script_op_loop, 0, 1, 0, 0, 0);
+  put_event (f, script_op_sound, sound_type_tone, 100, 0, 440, 0);
+  fclose (f);
+
+  Script *script = script_create ();
+  CHECK (script_load (script, filename));
+  CHECK (script_length (script, script_main) == 7);
+  if (script_length (script, script_main) == 7)
+    {
+    CHECK (script_get (script, script_main, 0)->values[0] == 100);
+    CHECK (script_get (script, script_main, 1)->values[0] == 1);
+    CHECK (script_get (script, script_main, 2)->values[0] == 0);
+    CHECK (script_get (script, script_main, 3)->values[0] == 1);
+    CHECK (script_get (script, script_main, 4)->values[0] == 0);
+    }
+
+  // The whole script is played in a few steps
+  ScriptCursor cursor;
+  script_cursor_init (&cursor);
+  int steps = 0;
+  while (script_next (script, &cursor, INT32_MAX) && steps < 100) steps++;
+  CHECK (steps == 5);
+  script_destroy (script);
+  }
+
+/*==========================================================================
+  test_sounding_repeat
+  A repeat that plays a sound, even in a definition, keeps its count
+==========================================================================*/
+static void test_sounding_repeat (const char *filename)
+  {
+  FILE *f = fopen (filename, "wb");
+  fwrite ("TGSC", 4, 1, f);
+  put32 (f, 2); put32 (f, 2); put32 (f, 3);
+  put_event (f, script_op_sound, sound_type_silence, 10, 0, 0, 0);
+  put_event (f, script_op_return, 0, 0, 0, 0, 0);
+  put_event (f, script_op_repeat, 0, 1000, 3, 0, 0);
+  put_event (f, script_op_call, 0, 0, 0, 0, 0);
+  put_event (f, script_op_loop, 0, 1, 0, 0, 0);
+  fclose (f);
+
+  Script *script = script_create ();
+  CHECK (script_load (script, filename));
+  if (script_length (script, script_main) == 3)
+    CHECK (script_get (script, script_main, 0)->values[0] == 1000);
+  script_destroy (script);
+  }
+
+/*==========================================================================
+  test_negative
+  A sound with a negative time or frequency makes the file invalid, and
+    nothing is loaded
+==========================================================================*/
+static void test_negative (const char *filename)
+  {
+  static const int bad[][4] = 
+    {{-100, 0, 440, 0}, {100, -5, 440, 0}, {100, 0, -440, 0}, 
+     {100, 0, 440, -1}};
+  for (int i = 0; i < 4; i++)
+    {
+    FILE *f = write_header (filename, 2);
+    put_event (f, script_op_sound, sound_type_tone, 100, 0, 440, 0);
+    put_event (f, script_op_sound, sound_type_sweep, 
+      bad[i][0], bad[i][1], bad[i][2], bad[i][3]);
+    fclose (f);
+
+    Script *script = script_create ();
+    CHECK (!script_load (script, filename));
+    CHECK (script_length (script, script_main) == 0);
+    script_destroy (script);
+    }
+  }
+
+/*==========================================================================
+  test_bad_loops
+  A loop that doesn't close the innermost open repeat, or a repeat that
+    is never closed, makes the file invalid. Otherwise a loop could 
+    send the player back over and over with no sound
+==========================================================================*/
+static void test_bad_loops (const char *filename)
+  {
+  // The loop the repeat points to doesn't go back to its body, and 
+  //   the loop before it closes nothing
+  FILE *f = write_header (filename, 4);
+  put_event (f, script_op_repeat, 0, INT32_MAX, 4, 0, 0);
+  put_event (f, script_op_loop, 0, 0, 0, 0, 0);
+  put_event (f, script_op_sound, sound_type_tone, 100, 0, 440, 0);
+  put_event (f, script_op_loop, 0, 2, 0, 0, 0);
+  fclose (f);
+  Script *script = script_create ();
+  CHECK (!script_load (script, filename));
+  CHECK (script_length (script, script_main) == 0);
+  script_destroy (script);
+
+  // The repeat is never closed
+  f = write_header (filename, 3);
+  put_event (f, script_op_repeat, 0, 5, 3, 0, 0);
+  put_event (f, script_op_sound, sound_type_tone, 100, 0, 440, 0);
+  put_event (f, script_op_sound, sound_type_tone, 100, 0, 440, 0);
+  fclose (f);
+  script = script_create ();
+  CHECK (!script_load (script, filename));
+  script_destroy (script);
+
+  // The inner repeat's loop closes the outer one
+  f = write_header (filename, 5);
+  put_event (f, script_op_repeat, 0, 5, 5, 0, 0);
+  put_event (f, script_op_repeat, 0, 5, 3, 0, 0);
+  put_event (f, script_op_sound, sound_type_tone, 100, 0, 440, 0);
+  put_event (f, script_op_loop, 0, 3, 0, 0, 0);
+  put_event (f, script_op_loop, 0, 3, 0, 0, 0);
+  fclose (f);
+  script = script_create ();
+  CHECK (!script_load (script, filename));
+  script_destroy (script);
+
+  // The same, with the loops right, is valid
+  f = write_header (filename, 5);
+  put_event (f, script_op_repeat, 0, 5, 5, 0, 0);
+  put_event (f, script_op_repeat, 0, 5, 3, 0, 0);
+  put_event (f, script_op_sound, sound_type_tone, 100, 0, 440, 0);
+  put_event (f, script_op_loop, 0, 1, 0, 0, 0);
+  put_event (f, script_op_loop, 0, 3, 0, 0, 0);
+  fclose (f);
+  script = script_create ();
+  CHECK (script_load (script, filename));
+  ScriptCursor cursor;
+  script_cursor_init (&cursor);
+  int steps = 0;
+  while (script_next (script, &cursor, INT32_MAX) && steps < 100) steps++;
+  CHECK (steps == 25);
+  script_destroy (script);
+  }
+
+/*==========================================================================
+  main
+==========================================================================*/
+int main (int argc, char **argv)
+  {
+  char filename[] = "/tmp/tonegen_testXXXXXX";
+  int fd = mkstemp (filename);
+  if (fd < 0)
+    {
+    perror ("mkstemp");
+    return 1;
+    }
+  close (fd);
+  log_set_handler (quiet_log);
+
+  test_limits (filename);
+  test_sounding_repeat (filename);
+  test_negative (filename);
+  test_bad_loops (filename);
+
+  unlink (filename);
+  if (failures) fprintf (stderr, "%d check(s) failed\n", failures);
+  return failures ? 1 : 0;
+  }